@@ -0,0 +1,319 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Low-precision positions of sun and moon and their rising and
+ * setting times, following Montenbruck and Pfleger, "Astronomy on
+ * the Personal Computer". The results are accurate to a few minutes,
+ * which is sufficient for day and night icons and as a replacement
+ * for the met.no sunrise service when it cannot be reached.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <libxfce4util/libxfce4util.h>
+#include <math.h>
+#include <string.h>
+
+#include "weather-parsers.h"
+#include "weather-astro.h"
+
+#define RAD (G_PI / 180.0)
+#define ARCSEC (3600.0 * 180.0 / G_PI)
+#define PI2 (2.0 * G_PI)
+
+/* days since the epoch of the Julian date 2000-01-01 12:00 UTC */
+#define J2000_DAYS(t) ((t) / 86400.0 + 2440587.5 - 2451545.0)
+
+#define OBLIQUITY (23.43929111 * RAD)
+
+/* altitudes of the center at rising and setting, corrected for
+   refraction, semidiameter and, for the moon, parallax */
+#define SUN_ALTITUDE (-0.833 * RAD)
+#define MOON_ALTITUDE (0.133 * RAD)
+
+typedef void (*position_func) (gdouble T, gdouble *lon, gdouble *lat);
+
+typedef struct {
+    gboolean has_rise;
+    gboolean has_set;
+    gboolean above;             /* above horizon at start of the day */
+    gdouble rise;               /* hours since start of the day */
+    gdouble set;
+} rise_set;
+
+static const gchar *moon_phase_names[] = {
+    "New moon",
+    "Waxing crescent",
+    "First quarter",
+    "Waxing gibbous",
+    "Full moon",
+    "Waning gibbous",
+    "Third quarter",
+    "Waning crescent"
+};
+
+
+static gdouble
+frac(gdouble x)
+{
+    return x - floor(x);
+}
+
+
+/*
+ * Ecliptic longitude of the sun, T in Julian centuries since J2000.
+ */
+static void
+sun_ecliptic(gdouble T,
+             gdouble *lon,
+             gdouble *lat)
+{
+    gdouble M;
+
+    M = PI2 * frac(0.993133 + 99.997361 * T);
+    *lon = PI2 * frac(0.7859453 + M / PI2 +
+                      (6893.0 * sin(M) + 72.0 * sin(2.0 * M)
+                       + 6191.2 * T) / 1296000.0);
+    *lat = 0;
+}
+
+
+/*
+ * Ecliptic coordinates of the moon, T in Julian centuries since J2000.
+ */
+static void
+moon_ecliptic(gdouble T,
+              gdouble *lon,
+              gdouble *lat)
+{
+    gdouble L0, l, ls, D, F, dL, S, h, N;
+
+    L0 = frac(0.606433 + 1336.855225 * T);
+    l = PI2 * frac(0.374897 + 1325.552410 * T);
+    ls = PI2 * frac(0.993133 + 99.997361 * T);
+    D = PI2 * frac(0.827361 + 1236.853086 * T);
+    F = PI2 * frac(0.259086 + 1342.227825 * T);
+
+    dL = 22640.0 * sin(l) - 4586.0 * sin(l - 2.0 * D)
+        + 2370.0 * sin(2.0 * D) + 769.0 * sin(2.0 * l)
+        - 668.0 * sin(ls) - 412.0 * sin(2.0 * F)
+        - 212.0 * sin(2.0 * l - 2.0 * D) - 206.0 * sin(l + ls - 2.0 * D)
+        + 192.0 * sin(l + 2.0 * D) - 165.0 * sin(ls - 2.0 * D)
+        - 125.0 * sin(D) - 110.0 * sin(l + ls)
+        + 148.0 * sin(l - ls) - 55.0 * sin(2.0 * F - 2.0 * D);
+    S = F + (dL + 412.0 * sin(2.0 * F) + 541.0 * sin(ls)) / ARCSEC;
+    h = F - 2.0 * D;
+    N = -526.0 * sin(h) + 44.0 * sin(l + h) - 31.0 * sin(-l + h)
+        - 23.0 * sin(ls + h) + 11.0 * sin(-ls + h)
+        - 25.0 * sin(-2.0 * l + F) + 21.0 * sin(-l + F);
+
+    *lon = PI2 * frac(L0 + dL / 1296000.0);
+    *lat = (18520.0 * sin(S) + N) / ARCSEC;
+}
+
+
+/*
+ * Sine of the altitude above the given horizon at time t, in seconds
+ * since the epoch, for an observer at lat and lon (radians).
+ */
+static gdouble
+sin_altitude(position_func position,
+             gdouble horizon,
+             gdouble lat,
+             gdouble lon,
+             gdouble t)
+{
+    gdouble d = J2000_DAYS(t), ecl_lon, ecl_lat;
+    gdouble x, y, z, ra, dec, lst;
+
+    position(d / 36525.0, &ecl_lon, &ecl_lat);
+
+    /* rotate ecliptic to equatorial coordinates */
+    x = cos(ecl_lat) * cos(ecl_lon);
+    y = cos(OBLIQUITY) * cos(ecl_lat) * sin(ecl_lon)
+        - sin(OBLIQUITY) * sin(ecl_lat);
+    z = sin(OBLIQUITY) * cos(ecl_lat) * sin(ecl_lon)
+        + cos(OBLIQUITY) * sin(ecl_lat);
+    ra = atan2(y, x);
+    dec = atan2(z, sqrt(x * x + y * y));
+
+    /* local mean sidereal time */
+    lst = PI2 * frac((280.46061837 + 360.98564736629 * d) / 360.0) + lon;
+
+    return sin(lat) * sin(dec) + cos(lat) * cos(dec) * cos(lst - ra)
+        - sin(horizon);
+}
+
+
+/*
+ * Find the first rising and setting during the day by fitting
+ * parabolas through the altitudes at intervals of two hours. Days
+ * may be shorter or longer than 24 hours because of DST changes.
+ */
+static void
+find_rise_set(position_func position,
+              gdouble horizon,
+              gdouble lat,
+              gdouble lon,
+              time_t day_t,
+              time_t next_day_t,
+              rise_set *rs)
+{
+    gdouble hours = difftime(next_day_t, day_t) / 3600.0;
+    gdouble start = (gdouble) day_t, hour;
+    gdouble ym, y0, yp, a, b, xe, ye, dis, dx, z1, z2, rise, set;
+    gint nz;
+
+#define ALTITUDE(h)                                                     \
+    sin_altitude(position, horizon, lat, lon, start + (h) * 3600.0)
+
+    memset(rs, 0, sizeof(rise_set));
+    ym = ALTITUDE(0);
+    rs->above = (ym > 0);
+
+    for (hour = 1; hour - 1 < hours && !(rs->has_rise && rs->has_set);
+         hour += 2) {
+        y0 = ALTITUDE(hour);
+        yp = ALTITUDE(hour + 1);
+
+        a = 0.5 * (yp + ym) - y0;
+        b = 0.5 * (yp - ym);
+        nz = 0;
+        z1 = z2 = ye = 0;
+        if (fabs(a) > 1e-12) {
+            xe = -b / (2.0 * a);
+            ye = (a * xe + b) * xe + y0;
+            dis = b * b - 4.0 * a * y0;
+            if (dis >= 0) {
+                dx = 0.5 * sqrt(dis) / fabs(a);
+                z1 = xe - dx;
+                z2 = xe + dx;
+                if (fabs(z1) <= 1.0)
+                    nz++;
+                if (fabs(z2) <= 1.0)
+                    nz++;
+                if (z1 < -1.0)
+                    z1 = z2;
+            }
+        } else if (b != 0) {
+            z1 = -y0 / b;
+            if (fabs(z1) <= 1.0)
+                nz++;
+        }
+
+        if (nz == 1) {
+            if (ym < 0 && !rs->has_rise && hour + z1 < hours) {
+                rs->has_rise = TRUE;
+                rs->rise = hour + z1;
+            } else if (ym >= 0 && !rs->has_set && hour + z1 < hours) {
+                rs->has_set = TRUE;
+                rs->set = hour + z1;
+            }
+        } else if (nz == 2) {
+            /* sets first if the parabola has its minimum between */
+            if (ye < 0) {
+                rise = z2;
+                set = z1;
+            } else {
+                rise = z1;
+                set = z2;
+            }
+            if (!rs->has_rise && hour + rise < hours) {
+                rs->has_rise = TRUE;
+                rs->rise = hour + rise;
+            }
+            if (!rs->has_set && hour + set < hours) {
+                rs->has_set = TRUE;
+                rs->set = hour + set;
+            }
+        }
+        ym = yp;
+    }
+#undef ALTITUDE
+}
+
+
+static const gchar *
+moon_phase_name(time_t t)
+{
+    gdouble T = J2000_DAYS((gdouble) t) / 36525.0;
+    gdouble sun_lon, moon_lon, lat, phase;
+
+    sun_ecliptic(T, &sun_lon, &lat);
+    moon_ecliptic(T, &moon_lon, &lat);
+
+    /* elongation of the moon in eighths of a revolution, centered on
+       the principal phases */
+    phase = frac((moon_lon - sun_lon) / PI2 + 1.0 / 16.0);
+    return moon_phase_names[(gint) (phase * 8.0) % 8];
+}
+
+
+/*
+ * Calculate sun and moon rise and set times and the moon phase for
+ * the day from day_t to next_day_t, with lat and lon in degrees.
+ */
+xml_astro *
+calc_astro(gdouble lat,
+           gdouble lon,
+           time_t day_t,
+           time_t next_day_t)
+{
+    xml_astro *astro;
+    rise_set rs;
+
+    astro = make_astro();
+    if (G_UNLIKELY(astro == NULL))
+        return NULL;
+
+    astro->day = day_t;
+    lat *= RAD;
+    lon *= RAD;
+
+    find_rise_set(sun_ecliptic, SUN_ALTITUDE, lat, lon,
+                  day_t, next_day_t, &rs);
+    if (rs.has_rise || rs.has_set) {
+        /* if the sun only rises or sets on this day, it is up until
+           the end or from the start of the day respectively */
+        astro->sunrise = rs.has_rise
+            ? day_t + (time_t) (rs.rise * 3600.0) : day_t;
+        astro->sunset = rs.has_set
+            ? day_t + (time_t) (rs.set * 3600.0) : next_day_t;
+    } else {
+        astro->sun_never_rises = !rs.above;
+        astro->sun_never_sets = rs.above;
+    }
+
+    find_rise_set(moon_ecliptic, MOON_ALTITUDE, lat, lon,
+                  day_t, next_day_t, &rs);
+    if (rs.has_rise)
+        astro->moonrise = day_t + (time_t) (rs.rise * 3600.0);
+    if (rs.has_set)
+        astro->moonset = day_t + (time_t) (rs.set * 3600.0);
+    if (!rs.has_rise && !rs.has_set) {
+        astro->moon_never_rises = !rs.above;
+        astro->moon_never_sets = rs.above;
+    }
+
+    astro->moon_phase =
+        g_strdup(moon_phase_name(day_t + (next_day_t - day_t) / 2));
+    return astro;
+}
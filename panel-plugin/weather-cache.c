@@ -0,0 +1,359 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "weather-parsers.h"
+#include "weather-data.h"
+#include "weather.h"
+
+#include "weather-cache.h"
+#include "weather-translate.h"
+#include "weather-debug.h"
+
+/*
+ * The binary cache file consists of a header followed by the packed
+ * astro records and then the packed timeslice records. It is written
+ * in host byte order and only meant to be read by the same machine;
+ * any mismatch in the header makes the file be ignored, so that a new
+ * one will be written after the next download.
+ */
+#define CACHE_MAGIC "XFWCACHE"
+#define CACHE_VERSION 3
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_COORD_LEN 32
+#define CACHE_MOON_PHASE_LEN 32
+#define CACHE_ETAG_LEN 128
+#define CACHE_DATE_LEN 64
+
+/* validators of the last download, see update_info */
+typedef struct {
+    gchar etag[CACHE_ETAG_LEN];
+    gchar last_modified[CACHE_DATE_LEN];
+    gint64 expires;
+} cache_validators;
+
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 header_size;
+    guint32 astro_size;
+    guint32 timeslice_size;
+    guint32 loc_values_num;
+    guint32 num_astro;
+    guint32 num_timeslices;
+    gint32 msl;
+    guint32 reserved;
+    gchar lat[CACHE_COORD_LEN];
+    gchar lon[CACHE_COORD_LEN];
+    gint64 cache_date;
+    gint64 last_weather_download;
+    gint64 last_astro_download;
+    cache_validators weather_validators;
+    cache_validators astro_validators;
+    gint64 weather_next_run;
+} cache_header;
+
+typedef struct {
+    gint64 day;
+    gint64 sunrise;
+    gint64 sunset;
+    gint64 moonrise;
+    gint64 moonset;
+    guint8 sun_never_rises;
+    guint8 sun_never_sets;
+    guint8 moon_never_rises;
+    guint8 moon_never_sets;
+    gchar moon_phase[CACHE_MOON_PHASE_LEN];
+} cache_astro;
+
+typedef struct {
+    gint64 start;
+    gint64 end;
+    gint64 point;
+    gdouble values[LOC_VALUES_NUM];
+    guint32 valid;
+    gint32 symbol_id;
+} cache_timeslice;
+
+
+/*
+ * Validators that do not fit are not stored, which only means the
+ * next download will not be conditional.
+ */
+static void
+store_validators(cache_validators *dst,
+                 const update_info *upi)
+{
+    if (upi->etag && strlen(upi->etag) < sizeof(dst->etag))
+        g_strlcpy(dst->etag, upi->etag, sizeof(dst->etag));
+    if (upi->last_modified &&
+        strlen(upi->last_modified) < sizeof(dst->last_modified))
+        g_strlcpy(dst->last_modified, upi->last_modified,
+                  sizeof(dst->last_modified));
+    dst->expires = upi->expires;
+}
+
+
+static void
+load_validators(update_info *upi,
+                const cache_validators *src)
+{
+    g_free(upi->etag);
+    upi->etag = NULL;
+    if (src->etag[0])
+        upi->etag = g_strndup(src->etag, sizeof(src->etag));
+    g_free(upi->last_modified);
+    upi->last_modified = NULL;
+    if (src->last_modified[0])
+        upi->last_modified = g_strndup(src->last_modified,
+                                       sizeof(src->last_modified));
+    upi->expires = src->expires;
+}
+
+
+GByteArray *
+cache_file_serialize(const plugin_data *data)
+{
+    GByteArray *out;
+    cache_header header;
+    cache_astro rec_astro;
+    cache_timeslice rec_ts;
+    xml_weather *wd = data->weatherdata;
+    xml_time *timeslice;
+    xml_astro *astro;
+    guint i, num_astro = 0, num_timeslices = 0;
+
+    if (G_UNLIKELY(wd == NULL || data->lat == NULL || data->lon == NULL))
+        return NULL;
+
+    out = g_byte_array_sized_new(sizeof(header)
+                                 + wd->timeslices->len * sizeof(rec_ts));
+
+    /* reserve space for the header, it is filled in at the end */
+    memset(&header, 0, sizeof(header));
+    g_byte_array_append(out, (const guint8 *) &header, sizeof(header));
+
+    if (data->astrodata)
+        for (i = 0; i < data->astrodata->len; i++) {
+            astro = g_array_index(data->astrodata, xml_astro *, i);
+            if (G_UNLIKELY(astro == NULL))
+                continue;
+            memset(&rec_astro, 0, sizeof(rec_astro));
+            rec_astro.day = astro->day;
+            rec_astro.sunrise = astro->sunrise;
+            rec_astro.sunset = astro->sunset;
+            rec_astro.moonrise = astro->moonrise;
+            rec_astro.moonset = astro->moonset;
+            rec_astro.sun_never_rises = astro->sun_never_rises;
+            rec_astro.sun_never_sets = astro->sun_never_sets;
+            rec_astro.moon_never_rises = astro->moon_never_rises;
+            rec_astro.moon_never_sets = astro->moon_never_sets;
+            if (astro->moon_phase)
+                g_strlcpy(rec_astro.moon_phase, astro->moon_phase,
+                          sizeof(rec_astro.moon_phase));
+            g_byte_array_append(out, (const guint8 *) &rec_astro,
+                                sizeof(rec_astro));
+            num_astro++;
+        }
+
+    for (i = 0; i < wd->timeslices->len; i++) {
+        timeslice = g_array_index(wd->timeslices, xml_time *, i);
+        if (G_UNLIKELY(timeslice == NULL || timeslice->location == NULL))
+            continue;
+        memset(&rec_ts, 0, sizeof(rec_ts));
+        rec_ts.start = timeslice->start;
+        rec_ts.end = timeslice->end;
+        rec_ts.point = timeslice->point;
+        memcpy(rec_ts.values, timeslice->location->values,
+               sizeof(rec_ts.values));
+        rec_ts.valid = timeslice->location->valid;
+        rec_ts.symbol_id = timeslice->location->symbol_id;
+        g_byte_array_append(out, (const guint8 *) &rec_ts, sizeof(rec_ts));
+        num_timeslices++;
+    }
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.header_size = sizeof(cache_header);
+    header.astro_size = sizeof(cache_astro);
+    header.timeslice_size = sizeof(cache_timeslice);
+    header.loc_values_num = LOC_VALUES_NUM;
+    header.num_astro = num_astro;
+    header.num_timeslices = num_timeslices;
+    header.msl = data->msl;
+    g_strlcpy(header.lat, data->lat, sizeof(header.lat));
+    g_strlcpy(header.lon, data->lon, sizeof(header.lon));
+    header.cache_date = time(NULL);
+    if (G_LIKELY(data->weather_update)) {
+        header.last_weather_download = data->weather_update->last;
+        store_validators(&header.weather_validators, data->weather_update);
+        header.weather_next_run = data->weather_update->next_run;
+    }
+    if (G_LIKELY(data->astro_update)) {
+        header.last_astro_download = data->astro_update->last;
+        store_validators(&header.astro_validators, data->astro_update);
+    }
+    memcpy(out->data, &header, sizeof(header));
+
+    return out;
+}
+
+
+static gboolean
+cache_header_is_valid(const plugin_data *data,
+                      const cache_header *header,
+                      gsize length)
+{
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) ||
+        header->version != CACHE_VERSION ||
+        header->byte_order != CACHE_BYTE_ORDER ||
+        header->header_size != sizeof(cache_header) ||
+        header->astro_size != sizeof(cache_astro) ||
+        header->timeslice_size != sizeof(cache_timeslice) ||
+        header->loc_values_num != LOC_VALUES_NUM) {
+        weather_debug("Cache file has an unknown format.");
+        return FALSE;
+    }
+    if (length != sizeof(cache_header)
+        + (gsize) header->num_astro * sizeof(cache_astro)
+        + (gsize) header->num_timeslices * sizeof(cache_timeslice)) {
+        weather_debug("Cache file is truncated or corrupt.");
+        return FALSE;
+    }
+    if (strncmp(header->lat, data->lat, sizeof(header->lat)) ||
+        strncmp(header->lon, data->lon, sizeof(header->lon)) ||
+        header->msl != data->msl || header->num_timeslices < 1) {
+        weather_debug("The values in the cache file do not match the "
+                      "current plugin data.");
+        return FALSE;
+    }
+    if (difftime(time(NULL), (time_t) header->cache_date)
+        > data->cache_file_max_age) {
+        weather_debug("Cache file is too old and will not be used.");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+/*
+ * Load a binary cache file. The file is mapped into memory and its
+ * fixed-size records are copied into new astrodata and timeslices,
+ * so apart from validating the header no text needs to be parsed.
+ * Only the last download times of the update infos are set, the
+ * caller needs to schedule the next downloads.
+ */
+gboolean
+cache_file_load(plugin_data *data,
+                const gchar *file)
+{
+    GMappedFile *mapped;
+    const gchar *contents;
+    const cache_header *header;
+    const cache_astro *rec_astro;
+    const cache_timeslice *rec_ts;
+    xml_astro *astro;
+    xml_weather *wd;
+    xml_location *loc;
+    xml_time *timeslice;
+    gsize length;
+    guint i;
+
+    g_assert(data != NULL);
+    if (G_UNLIKELY(data == NULL || data->lat == NULL || data->lon == NULL))
+        return FALSE;
+
+    mapped = g_mapped_file_new(file, FALSE, NULL);
+    if (mapped == NULL) {
+        weather_debug("Could not map cache file %s.", file);
+        return FALSE;
+    }
+    contents = g_mapped_file_get_contents(mapped);
+    length = g_mapped_file_get_length(mapped);
+    header = (const cache_header *) contents;
+    if (contents == NULL || length < sizeof(cache_header) ||
+        !cache_header_is_valid(data, header, length)) {
+        g_mapped_file_unref(mapped);
+        return FALSE;
+    }
+    weather_debug("Reading binary cache file %s.", file);
+
+    if (G_LIKELY(data->weather_update)) {
+        data->weather_update->last = header->last_weather_download;
+        load_validators(data->weather_update, &header->weather_validators);
+        data->weather_update->next_run = header->weather_next_run;
+    }
+    if (G_LIKELY(data->astro_update)) {
+        data->astro_update->last = header->last_astro_download;
+        load_validators(data->astro_update, &header->astro_validators);
+    }
+
+    rec_astro = (const cache_astro *) (contents + sizeof(cache_header));
+    if (header->num_astro)
+        weather_debug("Reusing cached astrodata instead of downloading it.");
+    for (i = 0; i < header->num_astro; i++, rec_astro++) {
+        astro = make_astro();
+        if (G_UNLIKELY(astro == NULL))
+            continue;
+        astro->day = rec_astro->day;
+        astro->sunrise = rec_astro->sunrise;
+        astro->sunset = rec_astro->sunset;
+        astro->moonrise = rec_astro->moonrise;
+        astro->moonset = rec_astro->moonset;
+        astro->sun_never_rises = rec_astro->sun_never_rises;
+        astro->sun_never_sets = rec_astro->sun_never_sets;
+        astro->moon_never_rises = rec_astro->moon_never_rises;
+        astro->moon_never_sets = rec_astro->moon_never_sets;
+        astro->moon_phase = g_strndup(rec_astro->moon_phase,
+                                      sizeof(rec_astro->moon_phase));
+        merge_astro(data->astrodata, astro);
+    }
+
+    /* collect the timeslices and merge them all at once */
+    rec_ts = (const cache_timeslice *) rec_astro;
+    wd = make_weather_data();
+    for (i = 0; wd && i < header->num_timeslices; i++, rec_ts++) {
+        timeslice = make_timeslice();
+        if (G_UNLIKELY(timeslice == NULL))
+            continue;
+        timeslice->start = rec_ts->start;
+        timeslice->end = rec_ts->end;
+        timeslice->point = rec_ts->point;
+        loc = timeslice->location;
+        memcpy(loc->values, rec_ts->values, sizeof(loc->values));
+        loc->valid = rec_ts->valid;
+        loc->symbol_id = normalize_symbol_id(rec_ts->symbol_id);
+        g_array_append_val(wd->timeslices, timeslice);
+        xml_weather_index_add(wd, timeslice);
+    }
+    if (G_LIKELY(wd)) {
+        merge_weather(data->weatherdata, wd);
+        xml_weather_free(wd);
+    }
+
+    g_mapped_file_unref(mapped);
+    weather_debug("Reading binary cache file complete.");
+    return TRUE;
+}
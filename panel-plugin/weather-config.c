@@ -111,6 +111,19 @@ update_summary_window(xfceweather_dialog *dialog,
 }
 
 
+/*
+ * Values are stored in SI units and formatted only for display, so
+ * changes to units or rounding just need to render the data again.
+ */
+static void
+update_presentation(xfceweather_dialog *dialog)
+{
+    invalidate_tooltip(dialog->pd);
+    update_valuebox(dialog->pd, TRUE);
+    update_summary_window(dialog, TRUE);
+}
+
+
 static gboolean
 schedule_data_update(gpointer user_data)
 {
@@ -392,6 +405,7 @@ text_loc_name_changed(const GtkWidget *spin,
     g_free(dialog->pd->location_name);
     dialog->pd->location_name =
         g_strdup(gtk_entry_get_text(GTK_ENTRY(dialog->text_loc_name)));
+    invalidate_tooltip(dialog->pd);
 }
 
 
@@ -400,11 +414,17 @@ spin_lat_value_changed(const GtkWidget *spin,
                        gpointer user_data)
 {
     xfceweather_dialog *dialog = (xfceweather_dialog *) user_data;
+    gchar *lat;
     gdouble val;
 
     val = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
+    lat = double_to_string(val, "%.6f");
+    if (!g_strcmp0(lat, dialog->pd->lat)) {
+        g_free(lat);
+        return;
+    }
     g_free(dialog->pd->lat);
-    dialog->pd->lat = double_to_string(val, "%.6f");
+    dialog->pd->lat = lat;
     schedule_delayed_data_update(dialog);
 }
 
@@ -414,11 +434,17 @@ spin_lon_value_changed(const GtkWidget *spin,
                        gpointer user_data)
 {
     xfceweather_dialog *dialog = (xfceweather_dialog *) user_data;
+    gchar *lon;
     gdouble val;
 
     val = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
+    lon = double_to_string(val, "%.6f");
+    if (!g_strcmp0(lon, dialog->pd->lon)) {
+        g_free(lon);
+        return;
+    }
     g_free(dialog->pd->lon);
-    dialog->pd->lon = double_to_string(val, "%.6f");
+    dialog->pd->lon = lon;
     schedule_delayed_data_update(dialog);
 }
 
@@ -433,6 +459,8 @@ spin_alt_value_changed(const GtkWidget *spin,
     val = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
     if (dialog->pd->units->altitude == FEET)
         val *= 0.3048;
+    if ((gint) val == dialog->pd->msl)
+        return;
     dialog->pd->msl = (gint) val;
     schedule_delayed_data_update(dialog);
 }
@@ -443,10 +471,12 @@ text_timezone_changed(const GtkWidget *entry,
                       gpointer user_data)
 {
     xfceweather_dialog *dialog = (xfceweather_dialog *) user_data;
+    const gchar *timezone = gtk_entry_get_text(GTK_ENTRY(entry));
 
-    if (dialog->pd->timezone)
-        g_free(dialog->pd->timezone);
-    dialog->pd->timezone = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
+    if (!g_strcmp0(timezone, dialog->pd->timezone))
+        return;
+    g_free(dialog->pd->timezone);
+    dialog->pd->timezone = g_strdup(timezone);
     schedule_delayed_data_update(dialog);
 }
 
@@ -652,8 +682,7 @@ combo_unit_temperature_changed(GtkWidget *combo,
     dialog->pd->units->temperature =
         gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
     combo_unit_temperature_set_tooltip(combo);
-    update_valuebox(dialog->pd, TRUE);
-    update_summary_window(dialog, TRUE);
+    update_presentation(dialog);
 }
 
 
@@ -710,8 +739,7 @@ combo_unit_pressure_changed(GtkWidget *combo,
     dialog->pd->units->pressure =
         gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
     combo_unit_pressure_set_tooltip(combo);
-    update_valuebox(dialog->pd, TRUE);
-    update_summary_window(dialog, TRUE);
+    update_presentation(dialog);
 }
 
 
@@ -760,8 +788,7 @@ combo_unit_windspeed_changed(GtkWidget *combo,
     dialog->pd->units->windspeed =
         gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
     combo_unit_windspeed_set_tooltip(combo);
-    update_valuebox(dialog->pd, TRUE);
-    update_summary_window(dialog, TRUE);
+    update_presentation(dialog);
 }
 
 
@@ -798,8 +825,7 @@ combo_unit_precipitation_changed(GtkWidget *combo,
     dialog->pd->units->precipitation =
         gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
     combo_unit_precipitation_set_tooltip(combo);
-    update_valuebox(dialog->pd, TRUE);
-    update_summary_window(dialog, TRUE);
+    update_presentation(dialog);
 }
 
 
@@ -841,7 +867,7 @@ combo_unit_altitude_changed(GtkWidget *combo,
         gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
     combo_unit_altitude_set_tooltip(combo);
     setup_altitude(dialog);
-    update_summary_window(dialog, TRUE);
+    update_presentation(dialog);
 }
 
 
@@ -911,8 +937,7 @@ combo_apparent_temperature_changed(GtkWidget *combo,
     dialog->pd->units->apparent_temperature =
         gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
     combo_apparent_temperature_set_tooltip(combo);
-    update_valuebox(dialog->pd, TRUE);
-    update_summary_window(dialog, TRUE);
+    update_presentation(dialog);
 }
 
 
@@ -1099,6 +1124,7 @@ combo_tooltip_style_changed(GtkWidget *combo,
 {
     xfceweather_dialog *dialog = (xfceweather_dialog *) user_data;
     dialog->pd->tooltip_style = gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
+    invalidate_tooltip(dialog->pd);
 }
 
 
@@ -1152,8 +1178,7 @@ check_round_values_toggled(GtkWidget *button,
     xfceweather_dialog *dialog = (xfceweather_dialog *) user_data;
     dialog->pd->round =
         gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(button));
-    update_valuebox(dialog->pd, TRUE);
-    update_summary_window(dialog, TRUE);
+    update_presentation(dialog);
 }
 
 
@@ -1326,14 +1351,6 @@ create_appearance_page(xfceweather_dialog *dialog)
     return palign;
 }
 
-static void spin_update_interval_value_changed(const GtkWidget *spin,
-                                               gpointer user_data) {
-  xfceweather_dialog *dialog = (xfceweather_dialog *)user_data;
-  dialog->pd->update_interval =
-      gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(spin));
-  update_valuebox(dialog->pd, TRUE);
-}
-
 
 static gboolean
 button_appearance_font_pressed(GtkWidget *button,
@@ -1416,42 +1433,6 @@ button_appearance_color_set(GtkWidget *button,
 }
 
 
-static GtkWidget *
-create_interval_page(xfceweather_dialog *dialog)
-{
-    GtkWidget *palign, *page, *hbox, *label;
-    GtkSizeGroup *sg;
-    data_types type;
-    gint i, n;
-    gchar* update_interval;
-
-    ADD_PAGE(FALSE);
-    sg = gtk_size_group_new(GTK_SIZE_GROUP_HORIZONTAL);
-
-    /* How often should the weather be checked */
-    hbox = gtk_hbox_new(FALSE, BORDER);
-    label = gtk_label_new_with_mnemonic(_("_Update interval:"));
-    gtk_misc_set_alignment(GTK_MISC(label), 0, 0.5);
-    gtk_box_pack_start(GTK_BOX(hbox), label, TRUE, TRUE, 0);
-
-    update_interval = g_strdup_printf("%d", dialog->pd->update_interval);
-    ADD_SPIN(dialog->spin_update_interval, 10, 9999, 10,
-             dialog->pd->update_interval, 0, sg);
-    SET_TOOLTIP(dialog->spin_update_interval,
-                _("Decide how often the weather should be updated."));
-
-    label = gtk_label_new("seconds");
-    gtk_misc_set_alignment(GTK_MISC(label), 0, 0.5);
-    gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 0);
-
-    gtk_box_pack_start(GTK_BOX(page), hbox, FALSE, FALSE, 0);
-
-    g_free(update_interval);
-    g_object_unref(G_OBJECT(sg));
-    return palign;
-}
-
-
 static void
 notebook_page_switched(GtkNotebook *notebook,
                        GtkNotebookPage *page,
@@ -1545,12 +1526,6 @@ setup_notebook_signals(xfceweather_dialog *dialog)
     g_signal_connect(dialog->check_round_values, "toggled",
                      G_CALLBACK(check_round_values_toggled), dialog);
 
-    /* scrollbox page */
-    g_signal_connect(GTK_SPIN_BUTTON(dialog->spin_update_interval),
-                     "value-changed",
-                     G_CALLBACK(spin_update_interval_value_changed),
-                     dialog);
-
     /* notebook widget */
     gtk_widget_show_all(GTK_WIDGET(dialog->notebook));
     gtk_notebook_set_current_page(GTK_NOTEBOOK(dialog->notebook),
@@ -1580,9 +1555,6 @@ create_config_dialog(plugin_data *data,
     gtk_notebook_append_page(GTK_NOTEBOOK(dialog->notebook),
                              create_appearance_page(dialog),
                              gtk_label_new_with_mnemonic(_("_Appearance")));
-    gtk_notebook_append_page(GTK_NOTEBOOK(dialog->notebook),
-                             create_interval_page(dialog),
-                             gtk_label_new_with_mnemonic(_("_Interval")));
     setup_notebook_signals(dialog);
     gtk_box_pack_start(GTK_BOX(vbox), dialog->notebook, TRUE, TRUE, 0);
     gtk_widget_show(GTK_WIDGET(vbox));
@@ -55,9 +55,6 @@ typedef struct {
     GtkWidget *spin_forecast_days;
     GtkWidget *check_round_values;
     GtkWidget *check_single_row;
-
-    /* scrollbox page */
-    GtkWidget *spin_update_interval;
 } xfceweather_dialog;
 
 
@@ -32,16 +32,12 @@
 #define NIGHT_TIME_START 21
 #define NIGHT_TIME_END 5
 
-/* interval used for searching raw data relevant to a day */
-#define DAY_START 3
-#define DAY_END 33
+/* length of a forecast daytime interval in hours */
 #define DAYTIME_LEN 6
 
 /* If some value is not present or cannot be computed, return this instead */
 #define INVALID_VALUE -9999
 
-#define CHK_NULL(s) ((s) ? g_strdup(s) : g_strdup(""))
-
 #define ROUND_TO_INT(default_format) (round ? "%.0f" : default_format)
 
 /* Converts temperatures in Celcius to Fahrenheit while preventing
@@ -53,30 +49,34 @@ do {                                                     \
         temperature = 0;                                 \
 } while (0)
 
-#define LOCALE_DOUBLE(value, format)                        \
-    (value                                                  \
-     ? g_strdup_printf(format, g_ascii_strtod(value, NULL)) \
+#define LOCALE_DOUBLE(loc, v, format)                   \
+    (LOC_HAS(loc, v)                                    \
+     ? g_strdup_printf(format, (loc)->values[(v)])      \
      : g_strdup(""))
 
-#define INTERPOLATE_OR_COPY(var, radian)                    \
-    if (ipol)                                               \
-        comb->location->var =                               \
-            interpolate_gchar_value(start->location->var,   \
-                                    end->location->var,     \
-                                    comb->start, comb->end, \
-                                    comb->point, radian);   \
-    else                                                    \
-        comb->location->var = g_strdup(end->location->var);
+#define INTERPOLATE_OR_COPY(var, radian)                        \
+    if (ipol)                                                   \
+        interpolate_location_value(comb->location,              \
+                                   start->location,             \
+                                   end->location, var,          \
+                                   comb->start, comb->end,      \
+                                   comb->point, radian);        \
+    else                                                        \
+        COMB_END_COPY(var);
 
-#define COMB_END_COPY(var)                              \
-    comb->location->var = g_strdup(end->location->var);
+#define COMB_END_COPY(var)                                      \
+    if (LOC_HAS(end->location, var))                            \
+        LOC_SET(comb->location, var, end->location->values[var]);
 
 
-/* struct to store results from searches for point data */
+/* struct to store results from searches for point data, as ranges
+   of the sorted timeslices, which may contain interval data too */
 typedef struct {
-    GArray *before;
+    guint before;               /* index of first timeslice before point */
+    guint num_before;
     time_t point;
-    GArray *after;
+    guint after;                /* index of first timeslice after point */
+    guint num_after;
 } point_data_results;
 
 
@@ -104,28 +104,45 @@ double_to_string(const gdouble val,
 }
 
 
+/*
+ * Return date_t as a GDateTime in the given timezone, or in UTC if
+ * tz is NULL. Unlike localtime() and mktime(), this does not depend
+ * on the TZ environment variable and is safe to use from any thread.
+ */
+GDateTime *
+make_date_time(const time_t date_t,
+               GTimeZone *tz)
+{
+    GDateTime *utc, *dt;
+
+    utc = g_date_time_new_from_unix_utc((gint64) date_t);
+    if (G_UNLIKELY(utc == NULL) || tz == NULL)
+        return utc;
+    dt = g_date_time_to_timezone(utc, tz);
+    g_date_time_unref(utc);
+    return dt;
+}
+
+
 gchar *
 format_date(const time_t date_t,
             gchar *format,
-            gboolean local)
+            GTimeZone *tz)
 {
-    struct tm *tm;
-    time_t t = date_t;
-    gchar buf[40];
-    size_t size;
+    GDateTime *dt;
+    gchar *str = NULL;
 
-    if (G_LIKELY(local))
-        tm = localtime(&t);
-    else
-        tm = gmtime(&t);
+    dt = make_date_time(date_t, tz);
 
     /* A year <= 1970 means date has not been set */
-    if (G_UNLIKELY(tm == NULL) || tm->tm_year <= 70)
-        return g_strdup("-");
-    if (format == NULL)
-        format = "%Y-%m-%d %H:%M:%S";
-    size = strftime(buf, 40, format, tm);
-    return (size ? g_strdup(buf) : g_strdup("-"));
+    if (G_LIKELY(dt) && g_date_time_get_year(dt) > 1970) {
+        if (format == NULL)
+            format = "%Y-%m-%d %H:%M:%S";
+        str = g_date_time_format(dt, format);
+    }
+    if (dt)
+        g_date_time_unref(dt);
+    return (str ? str : g_strdup("-"));
 }
 
 
@@ -133,8 +150,8 @@ format_date(const time_t date_t,
 gboolean
 timeslice_is_interval(xml_time *timeslice)
 {
-    return (timeslice->location->symbol != NULL ||
-            timeslice->location->precipitation_value != NULL);
+    return (LOC_HAS(timeslice->location, LOC_SYMBOL) ||
+            LOC_HAS(timeslice->location, LOC_PRECIPITATION));
 }
 
 
@@ -147,11 +164,11 @@ calc_dewpoint(const xml_location *loc)
 {
     gdouble temp, humidity, val;
 
-    if (G_UNLIKELY(loc->humidity_value == NULL))
+    if (G_UNLIKELY(!LOC_HAS(loc, LOC_HUMIDITY)))
         return INVALID_VALUE;
 
-    temp = string_to_double(loc->temperature_value, 0);
-    humidity = string_to_double(loc->humidity_value, 0);
+    temp = loc->values[LOC_TEMPERATURE];
+    humidity = loc->values[LOC_HUMIDITY];
     val = log(humidity / 100);
     return (241.2 * val + 4222.03716 * temp / (241.2 + temp))
         / (17.5043 - val - 17.5043 * temp / (241.2 + temp));
@@ -164,9 +181,9 @@ calc_apparent_temperature(const xml_location *loc,
                           const apparent_temp_models model,
                           const gboolean night_time)
 {
-    gdouble temp = string_to_double(loc->temperature_value, 0);
-    gdouble windspeed = string_to_double(loc->wind_speed_mps, 0);
-    gdouble humidity = string_to_double(loc->humidity_value, 0);
+    gdouble temp = loc->values[LOC_TEMPERATURE];
+    gdouble windspeed = loc->values[LOC_WIND_SPEED_MPS];
+    gdouble humidity = loc->values[LOC_HUMIDITY];
     gdouble dp, e;
 
     switch (model) {
@@ -280,14 +297,14 @@ calc_apparent_temperature(const xml_location *loc,
  * direction the wind is coming _from_.
  */
 static gchar*
-wind_dir_name_by_deg(gchar *degrees, gboolean long_name)
+wind_dir_name_by_deg(const xml_location *loc, gboolean long_name)
 {
     gdouble deg;
 
-    if (G_UNLIKELY(degrees == NULL))
+    if (G_UNLIKELY(!LOC_HAS(loc, LOC_WIND_DIR_DEG)))
         return "";
 
-    deg = string_to_double(degrees, 0);
+    deg = loc->values[LOC_WIND_DIR_DEG];
 
     if (deg >= 360 - 22.5 || deg < 45 - 22.5)
         return (long_name) ? _("North") : _("N");
@@ -336,28 +353,28 @@ get_data(const xml_time *timeslice,
     case ALTITUDE:
         switch (units->altitude) {
         case METERS:
-            return LOCALE_DOUBLE(loc->altitude, "%.0f");
+            return LOCALE_DOUBLE(loc, LOC_ALTITUDE, "%.0f");
 
         case FEET:
-            val = string_to_double(loc->altitude, 0);
+            val = loc->values[LOC_ALTITUDE];
             val /= 0.3048;
             return g_strdup_printf(ROUND_TO_INT("%.2f"), val);
         }
 
     case LATITUDE:
-        return LOCALE_DOUBLE(loc->latitude, "%.4f");
+        return LOCALE_DOUBLE(loc, LOC_LATITUDE, "%.4f");
 
     case LONGITUDE:
-        return LOCALE_DOUBLE(loc->longitude, "%.4f");
+        return LOCALE_DOUBLE(loc, LOC_LONGITUDE, "%.4f");
 
     case TEMPERATURE:      /* source is in °C */
-        val = string_to_double(loc->temperature_value, 0);
+        val = loc->values[LOC_TEMPERATURE];
         if (units->temperature == FAHRENHEIT)
             CALC_FAHRENHEIT(round, val);
         return g_strdup_printf(ROUND_TO_INT("%.1f"), val);
 
     case PRESSURE:         /* source is in hectopascals */
-        val = string_to_double(loc->pressure_value, 0);
+        val = loc->values[LOC_PRESSURE];
         switch (units->pressure) {
         case INCH_MERCURY:
             val *= 0.03;
@@ -372,7 +389,7 @@ get_data(const xml_time *timeslice,
         return g_strdup_printf(ROUND_TO_INT("%.1f"), val);
 
     case WIND_SPEED:       /* source is in meters per hour */
-        val = string_to_double(loc->wind_speed_mps, 0);
+        val = loc->values[LOC_WIND_SPEED_MPS];
         switch (units->windspeed) {
         case KMH:
             val *= 3.6;
@@ -390,17 +407,17 @@ get_data(const xml_time *timeslice,
         return g_strdup_printf(ROUND_TO_INT("%.1f"), val);
 
     case WIND_BEAUFORT:
-        val = string_to_double(loc->wind_speed_beaufort, 0);
+        val = loc->values[LOC_WIND_SPEED_BEAUFORT];
         return g_strdup_printf("%.0f", val);
 
     case WIND_DIRECTION:
-        return g_strdup(wind_dir_name_by_deg(loc->wind_dir_deg, FALSE));
+        return g_strdup(wind_dir_name_by_deg(loc, FALSE));
 
     case WIND_DIRECTION_DEG:
-        return LOCALE_DOUBLE(loc->wind_dir_deg, ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_WIND_DIR_DEG, ROUND_TO_INT("%.1f"));
 
     case HUMIDITY:
-        return LOCALE_DOUBLE(loc->humidity_value, ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_HUMIDITY, ROUND_TO_INT("%.1f"));
 
     case DEWPOINT:
         val = calc_dewpoint(loc);
@@ -418,26 +435,26 @@ get_data(const xml_time *timeslice,
         return g_strdup_printf(ROUND_TO_INT("%.1f"), val);
 
     case CLOUDS_LOW:
-        return LOCALE_DOUBLE(loc->clouds_percent[CLOUDS_PERC_LOW],
+        return LOCALE_DOUBLE(loc, LOC_CLOUDS + CLOUDS_PERC_LOW,
                              ROUND_TO_INT("%.1f"));
 
     case CLOUDS_MID:
-        return LOCALE_DOUBLE(loc->clouds_percent[CLOUDS_PERC_MID],
+        return LOCALE_DOUBLE(loc, LOC_CLOUDS + CLOUDS_PERC_MID,
                              ROUND_TO_INT("%.1f"));
 
     case CLOUDS_HIGH:
-        return LOCALE_DOUBLE(loc->clouds_percent[CLOUDS_PERC_HIGH],
+        return LOCALE_DOUBLE(loc, LOC_CLOUDS + CLOUDS_PERC_HIGH,
                              ROUND_TO_INT("%.1f"));
 
     case CLOUDINESS:
-        return LOCALE_DOUBLE(loc->clouds_percent[CLOUDS_PERC_CLOUDINESS],
+        return LOCALE_DOUBLE(loc, LOC_CLOUDS + CLOUDS_PERC_CLOUDINESS,
                              ROUND_TO_INT("%.1f"));
 
     case FOG:
-        return LOCALE_DOUBLE(loc->fog_percent, ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_FOG, ROUND_TO_INT("%.1f"));
 
     case PRECIPITATION:   /* source is in millimeters */
-        val = string_to_double(loc->precipitation_value, 0);
+        val = loc->values[LOC_PRECIPITATION];
 
         /* For snow, adjust precipitation dependent on temperature. Source:
            http://answers.yahoo.com/question/index?qid=20061230123635AAAdZAe */
@@ -446,7 +463,7 @@ get_data(const xml_time *timeslice,
             loc->symbol_id == SYMBOL_SNOWTHUNDER ||
             loc->symbol_id == SYMBOL_SNOWSUNPOLAR ||
             loc->symbol_id == SYMBOL_SNOWSUNTHUNDER) {
-            temp = string_to_double(loc->temperature_value, 0);
+            temp = loc->values[LOC_TEMPERATURE];
             if (temp < -11.1111)      /* below 12 °F, low snow density */
                 val *= 12;
             else if (temp < -4.4444)  /* 12 to 24 °F, still low density */
@@ -466,7 +483,10 @@ get_data(const xml_time *timeslice,
             return g_strdup_printf("%.1f", val);
 
     case SYMBOL:
-        return CHK_NULL(loc->symbol);
+        if (!LOC_HAS(loc, LOC_SYMBOL) ||
+            loc->symbol_id < 0 || loc->symbol_id >= SYMBOL_COUNT)
+            return g_strdup("");
+        return g_strdup(symbol_names[loc->symbol_id]);
     }
 
     return g_strdup("");
@@ -544,10 +564,12 @@ get_unit(const units_config *units,
  * available, or fallback to reasonable arbitrary values.
  */
 gboolean
-is_night_time(const xml_astro *astro)
+is_night_time(const xml_astro *astro,
+              GTimeZone *tz)
 {
+    GDateTime *now_dt;
     time_t now_t;
-    struct tm now_tm;
+    gint hour;
 
     time(&now_t);
 
@@ -571,9 +593,12 @@ is_night_time(const xml_astro *astro)
     }
 
     /* no astrodata available, use fallback values */
-    now_tm = *localtime(&now_t);
-    return (now_tm.tm_hour >= NIGHT_TIME_START ||
-            now_tm.tm_hour < NIGHT_TIME_END);
+    now_dt = make_date_time(now_t, tz);
+    if (G_UNLIKELY(now_dt == NULL))
+        return FALSE;
+    hour = g_date_time_get_hour(now_dt);
+    g_date_time_unref(now_dt);
+    return (hour >= NIGHT_TIME_START || hour < NIGHT_TIME_END);
 }
 
 
@@ -590,15 +615,14 @@ calculate_symbol(xml_time *timeslice,
 
     loc = timeslice->location;
 
-    precipitation = string_to_double(loc->precipitation_value, 0);
+    precipitation = loc->values[LOC_PRECIPITATION];
     if (precipitation > 0)
         return;
 
     /* do some modifications only if we're making a timeslice for
        current conditions */
     if (current_conditions) {
-        cloudiness =
-            string_to_double(loc->clouds_percent[CLOUDS_PERC_CLOUDINESS], 0);
+        cloudiness = loc->values[LOC_CLOUDS + CLOUDS_PERC_CLOUDINESS];
         if (cloudiness >= 90)
             loc->symbol_id = SYMBOL_CLOUD;
         else if (cloudiness >= 30)
@@ -607,13 +631,12 @@ calculate_symbol(xml_time *timeslice,
             loc->symbol_id = SYMBOL_LIGHTCLOUD;
     }
 
-    fog = string_to_double(loc->fog_percent, 0);
+    fog = loc->values[LOC_FOG];
     if (fog >= 80)
         loc->symbol_id = SYMBOL_FOG;
 
-    /* update symbol name */
-    g_free(loc->symbol);
-    loc->symbol = g_strdup(symbol_names[loc->symbol_id]);
+    /* the symbol is always known after this */
+    LOC_SET_SYMBOL(loc, loc->symbol_id);
 }
 
 
@@ -646,32 +669,38 @@ interpolate_value(gdouble value_start,
 
 
 /*
- * convert gchar in a gdouble and interpolate the value
+ * Interpolate a location value between start and end and store the
+ * result in dst, copying the end value if there is no start value.
  */
-static gchar *
-interpolate_gchar_value(gchar *value_start,
-                        gchar *value_end,
-                        time_t start_t,
-                        time_t end_t,
-                        time_t between_t,
-                        gboolean radian)
+static void
+interpolate_location_value(xml_location *dst,
+                           const xml_location *start,
+                           const xml_location *end,
+                           const location_values v,
+                           time_t start_t,
+                           time_t end_t,
+                           time_t between_t,
+                           gboolean radian)
 {
     gdouble val_start, val_end, val_result;
 
-    if (G_UNLIKELY(value_end == NULL))
-        return NULL;
+    if (G_UNLIKELY(!LOC_HAS(end, v)))
+        return;
 
-    if (value_start == NULL)
-        return g_strdup(value_end);
+    if (!LOC_HAS(start, v)) {
+        LOC_SET(dst, v, end->values[v]);
+        return;
+    }
 
-    val_start = string_to_double(value_start, 0);
-    val_end = string_to_double(value_end, 0);
+    val_start = start->values[v];
+    val_end = end->values[v];
 
-    if (radian)
+    if (radian) {
         if (val_end > val_start && val_end - val_start > 180)
             val_start += 360;
         else if (val_start > val_end && val_start - val_end > 180)
             val_end += 360;
+    }
     val_result = interpolate_value(val_start, val_end,
                                    start_t, end_t, between_t);
     if (radian && val_result >= 360)
@@ -679,7 +708,7 @@ interpolate_gchar_value(gchar *value_start,
 
     weather_debug("Interpolated data: start=%f, end=%f, result=%f",
                   val_start, val_end, val_result);
-    return double_to_string(val_result, "%.1f");
+    LOC_SET(dst, v, val_result);
 }
 
 
@@ -695,25 +724,19 @@ make_combined_timeslice(xml_weather *wd,
     gint i;
 
     /* find point data at start of interval (may not be available) */
-    start = get_timeslice(wd, interval->start, interval->start, NULL);
+    start = get_timeslice(wd, interval->start, interval->start);
 
     /* find point interval at end of interval */
-    end = get_timeslice(wd, interval->end, interval->end, NULL);
+    end = get_timeslice(wd, interval->end, interval->end);
 
     if (start == NULL && end == NULL)
         return NULL;
 
-    /* create new timeslice to hold our copy */
-    comb = g_slice_new0(xml_time);
+    /* create new timeslice to hold the combined data */
+    comb = make_timeslice();
     if (comb == NULL)
         return NULL;
 
-    comb->location = g_slice_new0(xml_location);
-    if (comb->location == NULL) {
-        g_slice_free(xml_time, comb);
-        return NULL;
-    }
-
     /* do not interpolate if no point data available at start of interval */
     if (start == NULL) {
         comb->point = end->start;
@@ -730,104 +753,130 @@ make_combined_timeslice(xml_weather *wd,
     comb->start = interval->start;
     comb->end = interval->end;
 
-    COMB_END_COPY(altitude);
-    COMB_END_COPY(latitude);
-    COMB_END_COPY(longitude);
-
-    INTERPOLATE_OR_COPY(temperature_value, FALSE);
-    COMB_END_COPY(temperature_unit);
+    COMB_END_COPY(LOC_ALTITUDE);
+    COMB_END_COPY(LOC_LATITUDE);
+    COMB_END_COPY(LOC_LONGITUDE);
 
-    INTERPOLATE_OR_COPY(wind_dir_deg, TRUE);
-    comb->location->wind_dir_name =
-        g_strdup(wind_dir_name_by_deg(comb->location->wind_dir_deg, FALSE));
+    INTERPOLATE_OR_COPY(LOC_TEMPERATURE, FALSE);
+    INTERPOLATE_OR_COPY(LOC_WIND_DIR_DEG, TRUE);
+    INTERPOLATE_OR_COPY(LOC_WIND_SPEED_MPS, FALSE);
+    INTERPOLATE_OR_COPY(LOC_WIND_SPEED_BEAUFORT, FALSE);
+    INTERPOLATE_OR_COPY(LOC_HUMIDITY, FALSE);
+    INTERPOLATE_OR_COPY(LOC_PRESSURE, FALSE);
 
-    INTERPOLATE_OR_COPY(wind_speed_mps, FALSE);
-    INTERPOLATE_OR_COPY(wind_speed_beaufort, FALSE);
-    INTERPOLATE_OR_COPY(humidity_value, FALSE);
-    COMB_END_COPY(humidity_unit);
+    for (i = LOC_CLOUDS; i < LOC_CLOUDS + CLOUDS_PERC_NUM; i++)
+        INTERPOLATE_OR_COPY(i, FALSE);
 
-    INTERPOLATE_OR_COPY(pressure_value, FALSE);
-    COMB_END_COPY(pressure_unit);
-
-    for (i = 0; i < CLOUDS_PERC_NUM; i++)
-        INTERPOLATE_OR_COPY(clouds_percent[i], FALSE);
-
-    INTERPOLATE_OR_COPY(fog_percent, FALSE);
+    INTERPOLATE_OR_COPY(LOC_FOG, FALSE);
 
     /* it makes no sense to interpolate the following (interval) values */
-    comb->location->precipitation_value =
-        g_strdup(interval->location->precipitation_value);
-    comb->location->precipitation_unit =
-        g_strdup(interval->location->precipitation_unit);
+    if (LOC_HAS(interval->location, LOC_PRECIPITATION))
+        LOC_SET(comb->location, LOC_PRECIPITATION,
+                interval->location->values[LOC_PRECIPITATION]);
 
-    comb->location->symbol_id = interval->location->symbol_id;
-    comb->location->symbol = g_strdup(interval->location->symbol);
+    if (LOC_HAS(interval->location, LOC_SYMBOL))
+        LOC_SET_SYMBOL(comb->location, interval->location->symbol_id);
 
     calculate_symbol(comb, current_conditions);
     return comb;
 }
 
 
+/*
+ * Add astro to astrodata, taking over the reference of the caller.
+ * Existing astrodata of the same date is replaced.
+ */
 void
 merge_astro(GArray *astrodata,
-            const xml_astro *astro)
+            xml_astro *astro)
 {
-    xml_astro *old_astro, *new_astro;
+    xml_astro *old_astro;
     guint index;
 
-    g_assert(astrodata != NULL);
-    if (G_UNLIKELY(astrodata == NULL))
+    g_assert(astrodata != NULL && astro != NULL);
+    if (G_UNLIKELY(astrodata == NULL || astro == NULL))
         return;
 
-    /* copy astro, as it may be deleted by the calling function */
-    new_astro = xml_astro_copy(astro);
-
-    /* check for and replace existing astrodata of the same date */
     if ((old_astro = get_astro(astrodata, astro->day, &index))) {
-        xml_astro_free(old_astro);
-        g_array_remove_index(astrodata, index);
-        g_array_insert_val(astrodata, index, new_astro);
+        xml_astro_unref(old_astro);
+        g_array_index(astrodata, xml_astro *, index) = astro;
         weather_debug("Replaced existing astrodata at %d.", index);
     } else {
-        g_array_append_val(astrodata, new_astro);
+        g_array_append_val(astrodata, astro);
         weather_debug("Appended new astrodata to the existing data.");
     }
 }
 
 
+/*
+ * Merge the timeslices of src into wd, taking ownership of them.
+ * They are sorted once and then merged with the sorted timeslices of
+ * wd in a single pass, new data replacing old data for the same
+ * interval. src is left empty.
+ */
 void
-merge_timeslice(xml_weather *wd,
-                const xml_time *timeslice)
+merge_weather(xml_weather *wd,
+              xml_weather *src)
 {
-    xml_time *old_ts, *new_ts;
+    GArray *merged;
+    xml_time *old_ts, *new_ts, *ts, *last;
     time_t now_t = time(NULL);
-    guint index;
+    guint i = 0, j = 0, replaced = 0;
 
-    g_assert(wd != NULL);
-    if (G_UNLIKELY(wd == NULL))
+    g_assert(wd != NULL && src != NULL);
+    if (G_UNLIKELY(wd == NULL || src == NULL))
         return;
 
-    /* first check if it isn't too old */
-    if (difftime(now_t, timeslice->end) > DATA_EXPIRY_TIME) {
-        weather_debug("Not merging timeslice because it has expired.");
-        return;
-    }
+    g_array_sort(src->timeslices, (GCompareFunc) xml_time_compare);
+    merged = g_array_sized_new(FALSE, TRUE, sizeof(xml_time *),
+                               wd->timeslices->len + src->timeslices->len);
+
+    while (i < wd->timeslices->len || j < src->timeslices->len) {
+        old_ts = (i < wd->timeslices->len)
+            ? g_array_index(wd->timeslices, xml_time *, i) : NULL;
+        new_ts = (j < src->timeslices->len)
+            ? g_array_index(src->timeslices, xml_time *, j) : NULL;
+
+        /* take old data first for equal intervals, so that it gets
+           replaced by the new data below */
+        if (new_ts == NULL ||
+            (old_ts && xml_time_compare(&old_ts, &new_ts) <= 0)) {
+            ts = old_ts;
+            i++;
+        } else {
+            ts = new_ts;
+            j++;
+            if (difftime(now_t, ts->end) > DATA_EXPIRY_TIME) {
+                weather_debug("Not merging timeslice because it has expired.");
+                xml_time_unref(ts);
+                continue;
+            }
+        }
+        if (G_UNLIKELY(ts == NULL))
+            continue;
 
-    /* Copy timeslice, as it will be deleted by the calling function */
-    new_ts = xml_time_copy(timeslice);
-
-    /* check if there is a timeslice with the same interval and
-       replace it with the current data */
-    old_ts = get_timeslice(wd, timeslice->start, timeslice->end, &index);
-    if (old_ts) {
-        xml_time_free(old_ts);
-        g_array_remove_index(wd->timeslices, index);
-        g_array_insert_val(wd->timeslices, index, new_ts);
-        weather_debug("Replaced existing timeslice at %d.", index);
-    } else {
-        g_array_prepend_val(wd->timeslices, new_ts);
-        //weather_debug("Prepended timeslice to the existing timeslices.");
+        if (merged->len > 0) {
+            last = g_array_index(merged, xml_time *, merged->len - 1);
+            if (last->start == ts->start && last->end == ts->end) {
+                /* update the index before the old timeslice is freed */
+                xml_weather_index_add(wd, ts);
+                xml_time_unref(last);
+                g_array_index(merged, xml_time *, merged->len - 1) = ts;
+                replaced++;
+                continue;
+            }
+        }
+        g_array_append_val(merged, ts);
+        if (ts == new_ts)
+            xml_weather_index_add(wd, ts);
     }
+
+    g_array_free(wd->timeslices, TRUE);
+    wd->timeslices = merged;
+    g_array_set_size(src->timeslices, 0);
+    g_hash_table_remove_all(src->ts_index);
+    weather_debug("Merged weather data, replaced %u timeslices, %u in total.",
+                  replaced, merged->len);
 }
 
 
@@ -840,49 +889,86 @@ get_current_conditions(const xml_weather *wd)
 
 
 time_t
-time_calc(const struct tm time_tm,
+time_calc(const time_t t,
           const gint year,
           const gint month,
           const gint day,
           const gint hour,
           const gint min,
-          const gint sec)
+          const gint sec,
+          GTimeZone *tz)
 {
+    GDateTime *dt, *new_dt;
     time_t result;
-    struct tm new_tm;
-
-    new_tm = time_tm;
-    new_tm.tm_isdst = -1;
-    if (year)
-        new_tm.tm_year += year;
-    if (month)
-        new_tm.tm_mon += month;
-    if (day)
-        new_tm.tm_mday += day;
-    if (hour)
-        new_tm.tm_hour += hour;
-    if (min)
-        new_tm.tm_min += min;
-    if (sec)
-        new_tm.tm_sec += sec;
-    result = mktime(&new_tm);
+
+    dt = make_date_time(t, tz);
+    if (G_UNLIKELY(dt == NULL))
+        return t;
+    new_dt = g_date_time_add_full(dt, year, month, day, hour, min, sec);
+    g_date_time_unref(dt);
+    if (G_UNLIKELY(new_dt == NULL))
+        return t;
+    result = (time_t) g_date_time_to_unix(new_dt);
+    g_date_time_unref(new_dt);
     return result;
 }
 
 
 time_t
-time_calc_hour(const struct tm time_tm,
-               const gint hours)
+time_calc_hour(const time_t t,
+               const gint hours,
+               GTimeZone *tz)
 {
-    return time_calc(time_tm, 0, 0, 0, hours, 0, 0);
+    return time_calc(t, 0, 0, 0, hours, 0, 0, tz);
 }
 
 
 time_t
-time_calc_day(const struct tm time_tm,
-              const gint days)
+time_calc_day(const time_t t,
+              const gint days,
+              GTimeZone *tz)
+{
+    return time_calc(t, 0, 0, days, 0, 0, 0, tz);
+}
+
+
+/*
+ * Return the start of the given hour on the day add_days after the
+ * day of day_t. Hours greater than 23 continue into the following
+ * day, which is needed for the night.
+ */
+static time_t
+time_at_hour(const time_t day_t,
+             gint add_days,
+             gint hour,
+             GTimeZone *tz)
 {
-    return time_calc(time_tm, 0, 0, days, 0, 0, 0);
+    GDateTime *dt, *day_dt;
+    gint year, month, mday;
+    time_t result;
+
+    add_days += hour / 24;
+    hour %= 24;
+
+    dt = make_date_time(day_t, tz);
+    if (G_UNLIKELY(dt == NULL))
+        return day_t;
+    day_dt = g_date_time_add_days(dt, add_days);
+    g_date_time_unref(dt);
+    if (G_UNLIKELY(day_dt == NULL))
+        return day_t;
+    g_date_time_get_ymd(day_dt, &year, &month, &mday);
+    g_date_time_unref(day_dt);
+
+    if (tz)
+        dt = g_date_time_new(tz, year, month, mday, hour, 0, 0);
+    else
+        dt = g_date_time_new_utc(year, month, mday, hour, 0, 0);
+    if (G_UNLIKELY(dt == NULL))
+        return day_t;
+    result = (time_t) g_date_time_to_unix(dt);
+    g_date_time_unref(dt);
+    return result;
 }
 
 
@@ -907,27 +993,34 @@ xml_astro_compare(gconstpointer a,
 }
 
 
+/*
+ * Remove expired astrodata in a single pass, moving the remaining
+ * entries to the front so that their order is preserved.
+ */
 void
 astrodata_clean(GArray *astrodata)
 {
     xml_astro *astro;
     time_t now_t = time(NULL);
-    gint i;
+    guint i, j;
 
     if (G_UNLIKELY(astrodata == NULL))
         return;
 
-    for (i = 0; i < astrodata->len; i++) {
+    for (i = 0, j = 0; i < astrodata->len; i++) {
         astro = g_array_index(astrodata, xml_astro *, i);
         if (G_UNLIKELY(astro == NULL))
             continue;
         if (difftime(now_t, astro->day) >= 24 * 3600) {
             weather_debug("Removing expired astrodata:");
             weather_dump(weather_dump_astro, astro);
-            xml_astro_free(astro);
-            g_array_remove_index(astrodata, i--);
-            weather_debug("Remaining astrodata entries: %d", astrodata->len);
-        }
+            xml_astro_unref(astro);
+        } else
+            g_array_index(astrodata, xml_astro *, j++) = astro;
+    }
+    if (j < astrodata->len) {
+        g_array_set_size(astrodata, j);
+        weather_debug("Remaining astrodata entries: %d", astrodata->len);
     }
 }
 
@@ -962,23 +1055,8 @@ xml_time_compare(gconstpointer a,
 }
 
 
-static void
-point_data_results_free(point_data_results *pdr)
-{
-    g_assert(pdr != NULL);
-    if (G_UNLIKELY(pdr == NULL))
-        return;
-
-    g_assert(pdr->before != NULL);
-    g_array_free(pdr->before, FALSE);
-    g_assert(pdr->after != NULL);
-    g_array_free(pdr->after, FALSE);
-    g_slice_free(point_data_results, pdr);
-    return;
-}
-
 /*
- * Given an array of point data, find two points for which
+ * Given ranges of point data, find two points for which
  * corresponding interval data can be found so that the interval is as
  * small as possible, returning NULL if such interval data doesn't
  * exist.
@@ -987,15 +1065,19 @@ static xml_time *
 find_smallest_interval(xml_weather *wd,
                        const point_data_results *pdr)
 {
-    GArray *before = pdr->before, *after = pdr->after;
     xml_time *ts_before, *ts_after, *found;
     gint i, j;
 
-    for (i = before->len - 1; i >= 0; i--) {
-        ts_before = g_array_index(before, xml_time *, i);
-        for (j = 0; j < after->len; j++) {
-            ts_after = g_array_index(after, xml_time *, j);
-            found = get_timeslice(wd, ts_before->start, ts_after->end, NULL);
+    for (i = pdr->before + pdr->num_before - 1; i >= (gint) pdr->before;
+         i--) {
+        ts_before = g_array_index(wd->timeslices, xml_time *, i);
+        if (timeslice_is_interval(ts_before))
+            continue;
+        for (j = pdr->after; j < pdr->after + pdr->num_after; j++) {
+            ts_after = g_array_index(wd->timeslices, xml_time *, j);
+            if (timeslice_is_interval(ts_after))
+                continue;
+            found = get_timeslice(wd, ts_before->start, ts_after->end);
             if (found)
                 return found;
         }
@@ -1009,20 +1091,17 @@ find_smallest_incomplete_interval(xml_weather *wd,
                                   time_t end_t)
 {
     xml_time *timeslice, *found = NULL;
-    gint i;
+    guint i;
 
     weather_debug("Searching for the smallest incomplete interval.");
-    /* search for all timeslices with interval data that have end time end_t */
-    for (i = 0; i < wd->timeslices->len; i++) {
+    /* intervals ending at end_t start before it, and the smallest one
+       is the one starting last, so search backwards from there */
+    get_timeslice_range(wd, end_t, end_t, &i);
+    while (i-- > 0) {
         timeslice = g_array_index(wd->timeslices, xml_time *, i);
-        if (timeslice && difftime(timeslice->end, end_t) == 0
-            && difftime(timeslice->end, timeslice->start) != 0) {
-            if (found == NULL)
-                found = timeslice;
-            else
-                if (difftime(timeslice->start, found->start) > 0)
-                    found = timeslice;
-            weather_dump(weather_dump_timeslice, found);
+        if (difftime(timeslice->end, end_t) == 0) {
+            found = timeslice;
+            break;
         }
     }
     weather_debug("Search result for smallest incomplete interval is:");
@@ -1032,93 +1111,35 @@ find_smallest_incomplete_interval(xml_weather *wd,
 
 
 /*
- * Given an array of point data, find two points for which
- * corresponding interval data can be found so that the interval is as
- * big as possible, returning NULL if such interval data doesn't
- * exist.
+ * Find point data within certain limits (in seconds) around a point
+ * in time, at or before and after it.
  */
-static xml_time *
-find_largest_interval(xml_weather *wd,
-                      const point_data_results *pdr)
-{
-    GArray *before = pdr->before, *after = pdr->after;
-    xml_time *ts_before = NULL, *ts_after = NULL, *found = NULL;
-    gint i, j;
-
-    for (i = before->len - 1; i >= 0; i--) {
-        ts_before = g_array_index(before, xml_time *, i);
-        for (j = after->len - 1; j >= 0; j--) {
-            ts_after = g_array_index(after, xml_time *, j);
-            found = get_timeslice(wd, ts_before->start, ts_after->end, NULL);
-            if (found) {
-                weather_debug("Found biggest interval:");
-                weather_dump(weather_dump_timeslice, found);
-                return found;
-            }
-        }
-    }
-    weather_debug("Could not find interval.");
-    return NULL;
-}
-
-
-/* find point data within certain limits around a point in time */
-static point_data_results *
+static void
 find_point_data(const xml_weather *wd,
                 const time_t point_t,
-                const gdouble min_diff,
-                const gdouble max_diff)
+                const time_t min_diff,
+                const time_t max_diff,
+                point_data_results *found)
 {
-    point_data_results *found;
-    xml_time *timeslice;
-    gdouble diff;
-    gint i;
-
-    found = g_slice_new0(point_data_results);
-    found->before = g_array_new(FALSE, TRUE, sizeof(xml_time *));
-    found->after = g_array_new(FALSE, TRUE, sizeof(xml_time *));
-
-    weather_debug("Checking %d timeslices for point data.",
-                  wd->timeslices->len);
-    for (i = 0; i < wd->timeslices->len; i++) {
-        timeslice = g_array_index(wd->timeslices, xml_time *, i);
-        /* look only for point data, not intervals */
-        if (G_UNLIKELY(timeslice == NULL) || timeslice_is_interval(timeslice))
-            continue;
-
-        /* add point data if within limits */
-        diff = difftime(timeslice->end, point_t);
-        if (diff <= 0) {  /* before point_t */
-            diff *= -1;
-            if (diff < min_diff || diff > max_diff)
-                continue;
-            g_array_append_val(found->before, timeslice);
-            weather_dump(weather_dump_timeslice, timeslice);
-        } else {          /* after point_t */
-            if (diff < min_diff || diff > max_diff)
-                continue;
-            g_array_append_val(found->after, timeslice);
-            weather_dump(weather_dump_timeslice, timeslice);
-        }
-    }
-    g_array_sort(found->before, (GCompareFunc) xml_time_compare);
-    g_array_sort(found->after, (GCompareFunc) xml_time_compare);
     found->point = point_t;
-    weather_debug("Found %d timeslices with point data, "
-                  "%d before and %d after point_t.",
-                  (found->before->len + found->after->len),
-                  found->before->len, found->after->len);
-    return found;
+    found->num_before = get_timeslice_range(wd, point_t - max_diff,
+                                            point_t - min_diff,
+                                            &found->before);
+    found->num_after = get_timeslice_range(wd, point_t + MAX(min_diff, 1),
+                                           point_t + max_diff,
+                                           &found->after);
+    weather_debug("Found %u timeslices before and %u after point_t.",
+                  found->num_before, found->num_after);
 }
 
 
 xml_time *
 make_current_conditions(xml_weather *wd,
-                        time_t now_t)
+                        time_t now_t,
+                        GTimeZone *tz)
 {
-    point_data_results *found = NULL;
+    point_data_results found;
     xml_time *interval = NULL, *incomplete;
-    struct tm point_tm = *localtime(&now_t);
     time_t point_t = now_t;
     gint i = 0;
 
@@ -1129,10 +1150,9 @@ make_current_conditions(xml_weather *wd,
     /* there may not be a timeslice available for the current
        interval, so look max three hours ahead */
     while (i < 3 && interval == NULL) {
-        point_t = time_calc_hour(point_tm, i);
-        found = find_point_data(wd, point_t, 1, 4 * 3600);
-        interval = find_smallest_interval(wd, found);
-        point_data_results_free(found);
+        point_t = time_calc_hour(point_t, i, tz);
+        find_point_data(wd, point_t, 1, 4 * 3600, &found);
+        interval = find_smallest_interval(wd, &found);
 
         /* There may be interval data where point data is only
            available at the end of that interval. If such an interval
@@ -1142,7 +1162,6 @@ make_current_conditions(xml_weather *wd,
             if ((incomplete =
                  find_smallest_incomplete_interval(wd, interval->start)))
                 interval = incomplete;
-        point_tm = *localtime(&point_t);
         i++;
     }
     weather_dump(weather_dump_timeslice, interval);
@@ -1157,17 +1176,11 @@ make_current_conditions(xml_weather *wd,
  * Add days to time_t and set the calculated day to midnight.
  */
 time_t
-day_at_midnight(time_t day_t,
-                const gint add_days)
+day_at_midnight(const time_t day_t,
+                const gint add_days,
+                GTimeZone *tz)
 {
-    struct tm day_tm;
-
-    day_tm = *localtime(&day_t);
-    day_tm.tm_mday += add_days;
-    day_tm.tm_hour = day_tm.tm_min = day_tm.tm_sec = 0;
-    day_tm.tm_isdst = -1;
-    day_t = mktime(&day_tm);
-    return day_t;
+    return time_at_hour(day_t, add_days, 0, tz);
 }
 
 
@@ -1176,7 +1189,8 @@ day_at_midnight(time_t day_t,
  */
 xml_astro *
 get_astro_data_for_day(const GArray *astrodata,
-                       const gint day)
+                       const gint day,
+                       GTimeZone *tz)
 {
     xml_astro *astro;
     time_t day_t = time(NULL);
@@ -1185,7 +1199,7 @@ get_astro_data_for_day(const GArray *astrodata,
     if (G_UNLIKELY(astrodata == NULL))
         return NULL;
 
-    day_t = day_at_midnight(day_t, day);
+    day_t = day_at_midnight(day_t, day, tz);
 
     for (i = 0; i < astrodata->len; i++) {
         astro = g_array_index(astrodata, xml_astro *, i);
@@ -1198,68 +1212,41 @@ get_astro_data_for_day(const GArray *astrodata,
 
 
 /*
- * Get all point data relevant for a given day.
+ * Return the earliest time at or after t that is 0, 6, 12 or 18
+ * hours UTC time.
  */
-GArray *
-get_point_data_for_day(xml_weather *wd,
-                       gint day)
+static time_t
+next_daytime_boundary(const time_t t)
 {
-    GArray *found;
-    xml_time *timeslice;
-    time_t day_t = time(NULL);
-    gint i;
-
-    day_t = day_at_midnight(day_t, day);
+    const time_t len = DAYTIME_LEN * 3600;
+    time_t rem = t % len;
 
-    /* loop over weather data and pick relevant point data */
-    found = g_array_new(FALSE, TRUE, sizeof(xml_time *));
-    g_assert(found != NULL);
-    if (G_UNLIKELY(found == NULL))
-        return NULL;
-
-    weather_debug("Checking %d timeslices for point data relevant to day %d.",
-                  wd->timeslices->len, day);
-    for (i = 0; i < wd->timeslices->len; i++) {
-        timeslice = g_array_index(wd->timeslices, xml_time *, i);
-
-        /* look only for point data, not intervals */
-        if (G_UNLIKELY(timeslice == NULL) || timeslice_is_interval(timeslice))
-            continue;
-
-        if (difftime(timeslice->start, day_t) >= DAY_START * 3600 &&
-            difftime(timeslice->end, day_t) <= DAY_END * 3600) {
-            weather_dump(weather_dump_timeslice, timeslice);
-            g_array_append_val(found, timeslice);
-        }
-    }
-    g_array_sort(found, (GCompareFunc) xml_time_compare);
-    weather_debug("Found %d timeslices for day %d.", found->len, day);
-    return found;
+    if (rem < 0)
+        rem += len;
+    return rem ? t + (len - rem) : t;
 }
 
 
 /*
- * Return forecast data for a given daytime, using the data provided.
+ * Return forecast data for a given daytime. Intervals start and end
+ * at 0, 6, 12, or 18 hours UTC time, so instead of comparing all
+ * point data of the day with each other, only these few times need
+ * to be looked up in the timeslice index of the weather data.
  */
 xml_time *
 make_forecast_data(xml_weather *wd,
-                   GArray *daydata,
                    gint day,
-                   daytime dt)
+                   daytime dt,
+                   GTimeZone *tz)
 {
-    xml_time *ts1, *ts2, *interval = NULL;
-    struct tm point_tm, start_tm, end_tm, tm1, tm2;
-    time_t point_t, start_t, end_t;
-    gint min = 0, max = 0, point = 0, i, j;
+    xml_time *interval = NULL;
+    time_t now_t, point_t, start_t, end_t, ts1_t, ts2_t;
+    gint min = 0, max = 0, point = 0;
 
     g_assert(wd != NULL);
     if (G_UNLIKELY(wd == NULL))
         return NULL;
 
-    g_assert(daydata != NULL);
-    if (G_UNLIKELY(daydata == NULL))
-        return NULL;
-
     /* choose search interval and desired point in time depending on daytime */
     switch (dt) {
     case MORNING:
@@ -1284,102 +1271,31 @@ make_forecast_data(xml_weather *wd,
         break;
     }
 
-    /* initialize times to the current day */
-    time(&point_t);
-    start_tm = end_tm = point_tm = *localtime(&point_t);
-
     /* calculate daytime limits for the requested day */
-    point_tm.tm_mday += day;
-    point_tm.tm_hour = point;
-    point_tm.tm_min = point_tm.tm_sec = 0;
-    point_tm.tm_isdst = -1;
-    point_t = mktime(&point_tm);
-
-    start_tm.tm_mday += day;
-    start_tm.tm_hour = min;
-    start_tm.tm_min = start_tm.tm_sec = 0;
-    start_tm.tm_isdst = -1;
-    start_t = mktime(&start_tm);
-
-    end_tm.tm_mday += day;
-    end_tm.tm_hour = max;
-    end_tm.tm_min = end_tm.tm_sec = 0;
-    end_tm.tm_isdst = -1;
-    end_t = mktime(&end_tm);
-
-    /* using search criteria, find an appropriate interval */
-    for (i = 0; i < daydata->len; i++) {
-        weather_debug("checking start ts %d", i);
-
-        /* try start timeslice for interval */
-        ts1 = g_array_index(daydata, xml_time *, i);
-
-        if (G_UNLIKELY(ts1 == NULL))
-            continue;
-        weather_debug("start ts is not null");
-
-        /* start timeslice needs to be within max daytime interval */
-        if (difftime(ts1->start, start_t) < 0 ||
-            difftime(end_t, ts1->start) < 0)
-            continue;
-        weather_debug("start ts is in max daytime interval");
-
-        /* start timeslice needs to start at 0, 6, 12, or 18 hours UTC time */
-        tm1 = *gmtime(&ts1->start);
-        if (tm1.tm_hour != 0 && tm1.tm_hour % 6 != 0)
+    now_t = time(NULL);
+    point_t = time_at_hour(now_t, day, point, tz);
+    start_t = time_at_hour(now_t, day, min, tz);
+    end_t = time_at_hour(now_t, day, max, tz);
+
+    /* the interval needs to start before and end after the daytime
+       point, both within the max daytime interval and with point
+       data available at start and end */
+    for (ts1_t = next_daytime_boundary(start_t);
+         difftime(point_t, ts1_t) >= 0;
+         ts1_t += DAYTIME_LEN * 3600) {
+        if (get_timeslice(wd, ts1_t, ts1_t) == NULL)
             continue;
-        weather_debug("start ts does start at 0, 6, 12, 18 hour UTC time");
-
-        for (j = 0; j < daydata->len; j++) {
-            weather_debug("checking end ts %d", j);
-
-            /* find end timeslice for interval */
-            ts2 = g_array_index(daydata, xml_time *, j);
-
-            if (G_UNLIKELY(ts2 == NULL))
-                continue;
-            weather_debug("end ts is not null");
+        weather_debug("found start ts at %ld", (long) ts1_t);
 
-            /* end timeslice has to be different from the start timeslice */
-            if (ts1 == ts2)
+        for (ts2_t = ts1_t + DAYTIME_LEN * 3600;
+             difftime(end_t, ts2_t) >= 0;
+             ts2_t += DAYTIME_LEN * 3600) {
+            if (difftime(ts2_t, point_t) < 0 ||
+                get_timeslice(wd, ts2_t, ts2_t) == NULL)
                 continue;
-            weather_debug("start ts is different from end ts");
-
-            /* end timeslice needs to be after start timeslice */
-            if (difftime(ts2->start, ts1->start) <= 0)
-                continue;
-            weather_debug("start ts is before end ts");
-
-            /* end timeslice needs to be in max daytime interval */
-            if (difftime(ts2->start, start_t) < 0 ||
-                difftime(end_t, ts2->start) < 0)
-                continue;
-            weather_debug("end ts is in max daytime interval");
-
-            /* end timeslice needs to start at 0, 6, 12, or 18 hours UTC time */
-            tm2 = *gmtime(&ts2->start);
-            if (tm2.tm_hour != 0 && tm2.tm_hour % 6 != 0)
-                continue;
-            weather_debug("end ts does start at 0, 6, 12, 18 hour UTC time");
-
-            /* start and end timeslice need to be a 6 hours interval... */
-            if (difftime(ts2->start, ts1->start) != DAYTIME_LEN * 3600)
-                /* ...however we may need to take into account possible dst
-                   difference so let's also try DAYTIME_LEN ±1 hour */
-                if ((difftime(ts2->start, ts1->start) < (DAYTIME_LEN - 1) * 3600 ||
-                     difftime(ts2->start, ts1->start) > (DAYTIME_LEN + 1) * 3600) &&
-                    get_timeslice(wd, ts1->start, ts2->end, NULL) == NULL)
-                    continue;
-            weather_debug("start and end ts are 6 hours apart");
-
-            /* daytime point needs to be within the interval */
-            if (difftime(point_t, ts1->start) < 0 ||
-                difftime(ts2->start, point_t) < 0)
-                continue;
-            weather_debug("daytime point is within the found interval");
 
             /* check whether the desired interval exists */
-            interval = get_timeslice(wd, ts1->start, ts2->end, NULL);
+            interval = get_timeslice(wd, ts1_t, ts2_t);
             if (interval == NULL)
                 continue;
 
@@ -1397,7 +1313,7 @@ make_forecast_data(xml_weather *wd,
         difftime(wd->current_conditions->start, start_t) >= 0 &&
         difftime(end_t, wd->current_conditions->end) >= 0) {
         interval = get_timeslice(wd, wd->current_conditions->start,
-                                 wd->current_conditions->end, NULL);
+                                 wd->current_conditions->end);
         weather_debug("returning current conditions interval for daytime %d "
                       "of day %d", dt, day);
         return make_combined_timeslice(wd, interval,
@@ -1409,3 +1325,82 @@ make_forecast_data(xml_weather *wd,
     weather_debug("no forecast data for daytime %d of day %d", dt, day);
     return NULL;
 }
+
+
+/*
+ * Calculate the forecast data for all days and daytimes at once, so
+ * that consumers like the summary window do not need to repeat the
+ * expensive search for intervals every time they are created.
+ */
+forecast_grid *
+make_forecast_grid(xml_weather *wd,
+                   const GArray *astrodata,
+                   const gint num_days,
+                   GTimeZone *tz)
+{
+    forecast_grid *grid;
+    xml_astro *astro;
+    gint day;
+    daytime dt;
+
+    if (G_UNLIKELY(wd == NULL || num_days < 1))
+        return NULL;
+
+    grid = g_slice_new0(forecast_grid);
+    grid->day_t = day_at_midnight(time(NULL), 0, tz);
+    grid->num_days = num_days;
+    grid->cells = g_new0(xml_time *, num_days * (NIGHT + 1));
+    grid->astro = g_new0(xml_astro *, num_days);
+
+    for (day = 0; day < num_days; day++) {
+        astro = get_astro_data_for_day(astrodata, day, tz);
+        if (astro)
+            grid->astro[day] = xml_astro_ref(astro);
+
+        for (dt = MORNING; dt <= NIGHT; dt++)
+            grid->cells[day * (NIGHT + 1) + dt] =
+                make_forecast_data(wd, day, dt, tz);
+    }
+    weather_debug("Calculated forecast data for %d days.", num_days);
+    return grid;
+}
+
+
+xml_time *
+forecast_grid_get(const forecast_grid *grid,
+                  const gint day,
+                  const daytime dt)
+{
+    if (G_UNLIKELY(grid == NULL || day < 0 || day >= grid->num_days))
+        return NULL;
+    return grid->cells[day * (NIGHT + 1) + dt];
+}
+
+
+xml_astro *
+forecast_grid_get_astro(const forecast_grid *grid,
+                        const gint day)
+{
+    if (G_UNLIKELY(grid == NULL || day < 0 || day >= grid->num_days))
+        return NULL;
+    return grid->astro[day];
+}
+
+
+void
+forecast_grid_free(forecast_grid *grid)
+{
+    gint i;
+
+    if (G_UNLIKELY(grid == NULL))
+        return;
+    for (i = 0; i < grid->num_days * (NIGHT + 1); i++)
+        if (grid->cells[i])
+            xml_time_unref(grid->cells[i]);
+    for (i = 0; i < grid->num_days; i++)
+        if (grid->astro[i])
+            xml_astro_unref(grid->astro[i]);
+    g_free(grid->cells);
+    g_free(grid->astro);
+    g_slice_free(forecast_grid, grid);
+}
@@ -87,6 +87,14 @@ typedef enum {
     NIGHT
 } daytime;
 
+/* combined forecast data for each day and daytime */
+typedef struct {
+    time_t day_t;               /* midnight of the first day */
+    gint num_days;
+    xml_time **cells;           /* num_days * 4 timeslices, may be NULL */
+    xml_astro **astro;          /* num_days astro records, may be NULL */
+} forecast_grid;
+
 typedef struct {
     gint temperature;
     gint apparent_temperature;
@@ -103,9 +111,12 @@ gdouble string_to_double(const gchar *str,
 gchar *double_to_string(gdouble val,
                         const gchar *format);
 
+GDateTime *make_date_time(const time_t t,
+                          GTimeZone *tz);
+
 gchar *format_date(const time_t t,
                    gchar *format,
-                   gboolean local);
+                   GTimeZone *tz);
 
 gboolean timeslice_is_interval(xml_time *timeslice);
 
@@ -118,21 +129,25 @@ gchar *get_data(const xml_time *timeslice,
 const gchar *get_unit(const units_config *units,
                       data_types type);
 
-gboolean is_night_time(const xml_astro *astro);
+gboolean is_night_time(const xml_astro *astro,
+                       GTimeZone *tz);
 
-time_t time_calc(struct tm time_tm,
+time_t time_calc(time_t t,
                  gint year,
                  gint mon,
                  gint day,
                  gint hour,
                  gint min,
-                 gint sec);
+                 gint sec,
+                 GTimeZone *tz);
 
-time_t time_calc_hour(struct tm time_tm,
-                      gint hours);
+time_t time_calc_hour(time_t t,
+                      gint hours,
+                      GTimeZone *tz);
 
-time_t time_calc_day(struct tm time_tm,
-                     gint days);
+time_t time_calc_day(time_t t,
+                     gint days,
+                     GTimeZone *tz);
 
 gint xml_astro_compare(gconstpointer a,
                        gconstpointer b);
@@ -141,31 +156,45 @@ gint xml_time_compare(gconstpointer a,
                       gconstpointer b);
 
 void merge_astro(GArray *astrodata,
-                 const xml_astro *astro);
+                 xml_astro *astro);
 
 void astrodata_clean(GArray *astrodata);
 
-void merge_timeslice(xml_weather *wd,
-                     const xml_time *timeslice);
+void merge_weather(xml_weather *wd,
+                   xml_weather *src);
 
 xml_time *get_current_conditions(const xml_weather *wd);
 
 xml_time *make_current_conditions(xml_weather *wd,
-                                  time_t now_t);
+                                  time_t now_t,
+                                  GTimeZone *tz);
 
 time_t day_at_midnight(time_t day_t,
-                       const gint add_days);
+                       const gint add_days,
+                       GTimeZone *tz);
 
 xml_astro *get_astro_data_for_day(const GArray *astrodata,
-                                  const gint day);
-
-GArray *get_point_data_for_day(xml_weather *wd,
-                               const gint day);
+                                  const gint day,
+                                  GTimeZone *tz);
 
 xml_time *make_forecast_data(xml_weather *wd,
-                             GArray *daydata,
                              gint day,
-                             daytime dt);
+                             daytime dt,
+                             GTimeZone *tz);
+
+forecast_grid *make_forecast_grid(xml_weather *wd,
+                                  const GArray *astrodata,
+                                  gint num_days,
+                                  GTimeZone *tz);
+
+xml_time *forecast_grid_get(const forecast_grid *grid,
+                            gint day,
+                            daytime dt);
+
+xml_astro *forecast_grid_get_astro(const forecast_grid *grid,
+                                   gint day);
+
+void forecast_grid_free(forecast_grid *grid);
 
 G_END_DECLS
 
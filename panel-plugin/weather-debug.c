@@ -235,11 +235,11 @@ weather_dump_astro(const xml_astro *astro)
     if (!astro)
         return g_strdup("Astrodata: NULL.");
 
-    day = format_date(astro->day, "%c", TRUE);
-    sunrise = format_date(astro->sunrise, "%c", TRUE);
-    sunset = format_date(astro->sunset, "%c", TRUE);
-    moonrise = format_date(astro->moonrise, "%c", TRUE);
-    moonset = format_date(astro->moonset, "%c", TRUE);
+    day = format_date(astro->day, "%c", NULL);
+    sunrise = format_date(astro->sunrise, "%c", NULL);
+    sunset = format_date(astro->sunset, "%c", NULL);
+    moonrise = format_date(astro->moonrise, "%c", NULL);
+    moonset = format_date(astro->moonset, "%c", NULL);
 
     out = g_strdup_printf("day=%s, sun={%s, %s, %s, %s}, "
                           "moon={%s, %s, %s, %s, %s}\n",
@@ -274,39 +274,37 @@ weather_dump_location(const xml_location *loc,
 
     if (interval)
         out =
-            g_strdup_printf("alt=%s, lat=%s, lon=%s, "
-                            "prec=%s %s, symid=%d (%s)",
-                            loc->altitude,
-                            loc->latitude,
-                            loc->longitude,
-                            loc->precipitation_value,
-                            loc->precipitation_unit,
+            g_strdup_printf("alt=%.0f, lat=%.4f, lon=%.4f, "
+                            "prec=%.1f mm, symid=%d (%s)",
+                            loc->values[LOC_ALTITUDE],
+                            loc->values[LOC_LATITUDE],
+                            loc->values[LOC_LONGITUDE],
+                            loc->values[LOC_PRECIPITATION],
                             loc->symbol_id,
-                            loc->symbol);
+                            LOC_HAS(loc, LOC_SYMBOL)
+                            ? symbol_names[loc->symbol_id] : "-");
     else
         out =
-            g_strdup_printf("alt=%s, lat=%s, lon=%s, temp=%s %s, "
-                            "wind=%s %s° %s m/s (%s bf), "
-                            "hum=%s %s, press=%s %s, fog=%s, cloudiness=%s, "
-                            "cl=%s, cm=%s, ch=%s)",
-                            loc->altitude,
-                            loc->latitude,
-                            loc->longitude,
-                            loc->temperature_value,
-                            loc->temperature_unit,
-                            loc->wind_dir_name,
-                            loc->wind_dir_deg,
-                            loc->wind_speed_mps,
-                            loc->wind_speed_beaufort,
-                            loc->humidity_value,
-                            loc->humidity_unit,
-                            loc->pressure_value,
-                            loc->pressure_unit,
-                            loc->fog_percent,
-                            loc->clouds_percent[CLOUDS_PERC_CLOUDINESS],
-                            loc->clouds_percent[CLOUDS_PERC_LOW],
-                            loc->clouds_percent[CLOUDS_PERC_MID],
-                            loc->clouds_percent[CLOUDS_PERC_HIGH]);
+            g_strdup_printf("alt=%.0f, lat=%.4f, lon=%.4f, temp=%.1f °C, "
+                            "wind=%.1f° %.1f m/s (%.0f bf), "
+                            "hum=%.1f %%, press=%.1f hPa, fog=%.1f, "
+                            "cloudiness=%.1f, cl=%.1f, cm=%.1f, ch=%.1f, "
+                            "valid=0x%x)",
+                            loc->values[LOC_ALTITUDE],
+                            loc->values[LOC_LATITUDE],
+                            loc->values[LOC_LONGITUDE],
+                            loc->values[LOC_TEMPERATURE],
+                            loc->values[LOC_WIND_DIR_DEG],
+                            loc->values[LOC_WIND_SPEED_MPS],
+                            loc->values[LOC_WIND_SPEED_BEAUFORT],
+                            loc->values[LOC_HUMIDITY],
+                            loc->values[LOC_PRESSURE],
+                            loc->values[LOC_FOG],
+                            loc->values[LOC_CLOUDS + CLOUDS_PERC_CLOUDINESS],
+                            loc->values[LOC_CLOUDS + CLOUDS_PERC_LOW],
+                            loc->values[LOC_CLOUDS + CLOUDS_PERC_MID],
+                            loc->values[LOC_CLOUDS + CLOUDS_PERC_HIGH],
+                            loc->valid);
     return out;
 }
 
@@ -347,8 +345,8 @@ weather_dump_timeslice(const xml_time *timeslice)
         return g_strdup("No timeslice data.");
 
     out = g_string_sized_new(512);
-    start = format_date(timeslice->start, "%c", TRUE);
-    end = format_date(timeslice->end, "%c", TRUE);
+    start = format_date(timeslice->start, "%c", NULL);
+    end = format_date(timeslice->end, "%c", NULL);
     is_interval = (gboolean) strcmp(start, end);
     loc = weather_dump_location((timeslice) ? timeslice->location : NULL,
                                 is_interval);
@@ -409,15 +407,17 @@ weather_dump_plugindata(const plugin_data *data)
     gchar *next_astro_update, *next_weather_update, *next_conditions_update;
     gchar *next_wakeup, *result;
 
-    last_astro_update = format_date(data->astro_update->last, "%c", TRUE);
-    last_weather_update = format_date(data->weather_update->last, "%c", TRUE);
+    last_astro_update = format_date(data->astro_update->last, "%c", data->tz);
+    last_weather_update =
+        format_date(data->weather_update->last, "%c", data->tz);
     last_conditions_update =
-        format_date(data->conditions_update->last, "%c", TRUE);
-    next_astro_update = format_date(data->astro_update->next, "%c", TRUE);
-    next_weather_update = format_date(data->weather_update->next, "%c", TRUE);
+        format_date(data->conditions_update->last, "%c", data->tz);
+    next_astro_update = format_date(data->astro_update->next, "%c", data->tz);
+    next_weather_update =
+        format_date(data->weather_update->next, "%c", data->tz);
     next_conditions_update =
-        format_date(data->conditions_update->next, "%c", TRUE);
-    next_wakeup = format_date(data->next_wakeup, "%c", TRUE);
+        format_date(data->conditions_update->next, "%c", data->tz);
+    next_wakeup = format_date(data->next_wakeup, "%c", data->tz);
 
     out = g_string_sized_new(1024);
     g_string_assign(out, "xfce_weatherdata:\n");
@@ -463,8 +463,6 @@ weather_dump_plugindata(const plugin_data *data)
                            "  valuebox font: %s\n"
                            "  valuebox color: %s\n"
                            "  --------------------------------------------\n",
-                           "  update interval: %d\n"
-                           "  --------------------------------------------\n",
                            data->panel_size,
                            data->panel_rows,
                            YESNO(data->single_row),
@@ -497,8 +495,7 @@ weather_dump_plugindata(const plugin_data *data)
                            data->forecast_days,
                            YESNO(data->round),
                            data->valuebox_font,
-                           gdk_color_to_string(&(data->valuebox_color)),
-                           data->update_interval);
+                           gdk_color_to_string(&(data->valuebox_color)));
     g_free(next_wakeup);
     g_free(next_astro_update);
     g_free(next_weather_update);
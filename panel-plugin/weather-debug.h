@@ -37,12 +37,27 @@ G_BEGIN_DECLS
 #endif
 #endif
 
-#define weather_debug(...)                                  \
-    weather_debug_real(G_LOG_DOMAIN, __FILE__, __func__,    \
-                       __LINE__, __VA_ARGS__)
+/*
+ * When debug mode is off, logging costs only a test of debug_mode.
+ * Building with WEATHER_DISABLE_DEBUG turns the test into a constant,
+ * so that the compiler removes the logging code entirely while the
+ * arguments are still checked.
+ */
+#ifdef WEATHER_DISABLE_DEBUG
+#define WEATHER_DEBUG_ENABLED FALSE
+#else
+#define WEATHER_DEBUG_ENABLED G_UNLIKELY(debug_mode)
+#endif
+
+#define weather_debug(...)                                      \
+    G_STMT_START {                                              \
+        if (WEATHER_DEBUG_ENABLED)                              \
+            weather_debug_real(G_LOG_DOMAIN, __FILE__, __func__, \
+                               __LINE__, __VA_ARGS__);          \
+    } G_STMT_END
 
 #define weather_dump(func, data)                \
-    if (G_UNLIKELY(debug_mode)) {               \
+    if (WEATHER_DEBUG_ENABLED) {                \
         gchar *msg = func(data);                \
         weather_debug("%s", msg);               \
         g_free(msg);                            \
@@ -34,58 +34,163 @@
 #define ICON_DIR_SMALL "22"
 #define ICON_DIR_MEDIUM "48"
 #define ICON_DIR_BIG "128"
+#define ICON_CACHE_SIZE 64
 
+/* icon keys pack size, size directory, symbol and day/night into an
+   int, the size is 0 for keys of missing icon files */
+#define ICON_KEY(size, sizedir, symbol, night)                  \
+    (((guint) (size) << 10) | ((guint) (sizedir) << 8) |       \
+     ((guint) (symbol) << 1) | ((night) ? 1 : 0))
+#define ICON_KEY_MAX_SIZE 0x3fffff
 
+typedef struct {
+    GdkPixbuf *pixbuf;
+    GList *link;                /* element of icon_theme->icon_lru */
+} icon_cache_entry;
+
+
+static const gchar *icon_sizedirs[] = {
+    ICON_DIR_SMALL,
+    ICON_DIR_MEDIUM,
+    ICON_DIR_BIG
+};
+
+
+/*
+ * Return the index of the size directory best matching the
+ * requested size.
+ */
+static guint
+get_icon_sizedir(const gint size)
+{
+    if (size < 24)
+        return 0;
+    else if (size < 49)
+        return 1;
+    return 2;
+}
+
+
+/*
+ * Return the index of a symbol name, or -1 if it is unknown.
+ */
+static gint
+find_symbol(const gchar *symbol_name)
+{
+    gint symbol;
+
+    for (symbol = 0; symbol < SYMBOL_COUNT; symbol++)
+        if (!strcmp(symbol_name, symbol_names[symbol]))
+            return symbol;
+    return -1;
+}
+
+
+/*
+ * Missing icon files are remembered by their size directory, symbol
+ * and day/night variant, which do not depend on the pixel size.
+ */
 static gboolean
 icon_missing(const icon_theme *theme,
-             const gchar *sizedir,
-             const gchar *symbol_name,
-             const gchar *suffix)
+             const guint sizedir,
+             const gint symbol,
+             const gboolean night)
 {
-    gchar *missing, *icon;
-    gint i;
-
-    icon = g_strconcat(sizedir, G_DIR_SEPARATOR_S, symbol_name, suffix, NULL);
-    for (i = 0; i < theme->missing_icons->len; i++) {
-        missing = g_array_index(theme->missing_icons, gchar *, i);
-        if (G_UNLIKELY(missing == NULL))
-            continue;
-        if (!strcmp(missing, icon)) {
-            g_free(icon);
-            return TRUE;
-        }
-    }
-    g_free(icon);
-    return FALSE;
+    if (G_UNLIKELY(symbol < 0))
+        return FALSE;
+    return g_hash_table_lookup(theme->missing_icons,
+                               GUINT_TO_POINTER(ICON_KEY(0, sizedir,
+                                                         symbol, night)))
+        != NULL;
 }
 
 
 static void
 remember_missing_icon(const icon_theme *theme,
-                      const gchar *sizedir,
-                      const gchar *symbol_name,
-                      const gchar *suffix)
+                      const guint sizedir,
+                      const gint symbol,
+                      const gboolean night)
 {
-    gchar *icon;
+    if (G_UNLIKELY(symbol < 0))
+        return;
+    g_hash_table_insert(theme->missing_icons,
+                        GUINT_TO_POINTER(ICON_KEY(0, sizedir, symbol, night)),
+                        GINT_TO_POINTER(TRUE));
+    weather_debug("Remembered missing icon %s/%s%s.", icon_sizedirs[sizedir],
+                  symbol_names[symbol], night ? "-night" : "");
+}
 
-    icon = g_strconcat(sizedir, G_DIR_SEPARATOR_S, symbol_name, suffix, NULL);
-    g_array_append_val(theme->missing_icons, icon);
-    weather_debug("Remembered missing icon %s.", icon);
+
+/*
+ * Make the key of an icon in the pixbuf cache, or return 0 if it
+ * should not be cached.
+ */
+static guint
+make_icon_key(const gchar *symbol_name,
+              const gint size,
+              const gboolean night)
+{
+    gint symbol;
+
+    if (G_UNLIKELY(size < 1 || size > ICON_KEY_MAX_SIZE))
+        return 0;
+
+    if (symbol_name == NULL || *symbol_name == '\0')
+        return ICON_KEY(size, get_icon_sizedir(size), SYMBOL_NODATA, FALSE);
+
+    if ((symbol = find_symbol(symbol_name)) < 0)
+        return 0;
+    return ICON_KEY(size, get_icon_sizedir(size), symbol, night);
 }
 
 
-static const gchar *
-get_icon_sizedir(const gint size)
+static void
+icon_cache_entry_free(gpointer user_data)
 {
-    const gchar *sizedir;
+    icon_cache_entry *entry = user_data;
 
-    if (size < 24)
-        sizedir = ICON_DIR_SMALL;
-    else if (size < 49)
-        sizedir = ICON_DIR_MEDIUM;
-    else
-        sizedir = ICON_DIR_BIG;
-    return sizedir;
+    g_object_unref(G_OBJECT(entry->pixbuf));
+    g_slice_free(icon_cache_entry, entry);
+}
+
+
+static GdkPixbuf *
+lookup_cached_icon(const icon_theme *theme,
+                   const guint key)
+{
+    icon_cache_entry *entry;
+
+    entry = g_hash_table_lookup(theme->icon_cache, GUINT_TO_POINTER(key));
+    if (entry == NULL)
+        return NULL;
+
+    /* move to the front of the LRU list */
+    g_queue_unlink(theme->icon_lru, entry->link);
+    g_queue_push_head_link(theme->icon_lru, entry->link);
+    return g_object_ref(entry->pixbuf);
+}
+
+
+static void
+remember_icon(const icon_theme *theme,
+              const guint key,
+              GdkPixbuf *pixbuf)
+{
+    icon_cache_entry *entry;
+    GList *link;
+
+    /* evict the least recently used icon */
+    if (g_queue_get_length(theme->icon_lru) >= ICON_CACHE_SIZE) {
+        link = g_queue_pop_tail_link(theme->icon_lru);
+        g_hash_table_remove(theme->icon_cache, link->data);
+        g_list_free_1(link);
+    }
+
+    entry = g_slice_new(icon_cache_entry);
+    entry->pixbuf = g_object_ref(pixbuf);
+    g_queue_push_head(theme->icon_lru, GUINT_TO_POINTER(key));
+    entry->link = g_queue_peek_head_link(theme->icon_lru);
+    g_hash_table_insert(theme->icon_cache, GUINT_TO_POINTER(key), entry);
 }
 
 
@@ -119,32 +224,30 @@ make_fallback_icon_filename(const gchar *sizedir)
 }
 
 
-GdkPixbuf *
-get_icon(const icon_theme *theme,
-         const gchar *symbol_name,
-         const gint size,
-         const gboolean night)
+static GdkPixbuf *
+load_icon(const icon_theme *theme,
+          const gchar *symbol_name,
+          const gint size,
+          const gboolean night)
 {
     GdkPixbuf *image = NULL;
     const gchar *sizedir;
     gchar *filename = NULL, *suffix = "";
-
-    g_assert(theme != NULL);
-    if (G_UNLIKELY(!theme)) {
-        g_warning(_("No icon theme!"));
-        return NULL;
-    }
+    guint sizedir_index;
+    gint symbol;
 
     /* choose icons from directory best matching the requested size */
-    sizedir = get_icon_sizedir(size);
+    sizedir_index = get_icon_sizedir(size);
+    sizedir = icon_sizedirs[sizedir_index];
 
     if (symbol_name == NULL || strlen(symbol_name) == 0)
         symbol_name = symbol_names[SYMBOL_NODATA];
     else if (night)
         suffix = "-night";
+    symbol = find_symbol(symbol_name);
 
     /* check whether icon has been verified to be missing before */
-    if (!icon_missing(theme, sizedir, symbol_name, suffix)) {
+    if (!icon_missing(theme, sizedir_index, symbol, *suffix != '\0')) {
         filename = make_icon_filename(theme, sizedir, symbol_name, suffix);
         image = gdk_pixbuf_new_from_file_at_scale(filename, size, size, TRUE, NULL);
     }
@@ -153,7 +256,8 @@ get_icon(const icon_theme *theme,
         /* remember failure for future lookups */
         if (filename) {
             weather_debug("Unable to open image: %s", filename);
-            remember_missing_icon(theme, sizedir, symbol_name, suffix);
+            remember_missing_icon(theme, sizedir_index, symbol,
+                                  *suffix != '\0');
             g_free(filename);
             filename = NULL;
         }
@@ -161,10 +265,10 @@ get_icon(const icon_theme *theme,
         if (strcmp(symbol_name, symbol_names[SYMBOL_NODATA]))
             if (night)
                 /* maybe there is no night icon, so fallback to using day icon... */
-                return get_icon(theme, symbol_name, size, FALSE);
+                return load_icon(theme, symbol_name, size, FALSE);
             else
                 /* ... or use NODATA if we tried that already */
-                return get_icon(theme, NULL, size, FALSE);
+                return load_icon(theme, NULL, size, FALSE);
         else {
             /* last chance: get NODATA icon from standard theme */
             filename = make_fallback_icon_filename(sizedir);
@@ -181,6 +285,38 @@ get_icon(const icon_theme *theme,
 }
 
 
+/*
+ * Get the icon for a symbol, which needs to be unreferenced by the
+ * caller. Decoded icons are cached, including the results of
+ * falling back to other icons, so only icons not used recently need
+ * to be loaded from disk.
+ */
+GdkPixbuf *
+get_icon(const icon_theme *theme,
+         const gchar *symbol_name,
+         const gint size,
+         const gboolean night)
+{
+    GdkPixbuf *image;
+    guint key;
+
+    g_assert(theme != NULL);
+    if (G_UNLIKELY(!theme)) {
+        g_warning(_("No icon theme!"));
+        return NULL;
+    }
+
+    key = make_icon_key(symbol_name, size, night);
+    if (key && (image = lookup_cached_icon(theme, key)))
+        return image;
+
+    image = load_icon(theme, symbol_name, size, night);
+    if (key && image)
+        remember_icon(theme, key, image);
+    return image;
+}
+
+
 /*
  * Create a new icon theme struct, initializing caches to undefined.
  */
@@ -192,7 +328,10 @@ make_icon_theme(void)
     g_assert(theme != NULL);
     if (theme == NULL)
         return NULL;
-    theme->missing_icons = g_array_new(FALSE, TRUE, sizeof(gchar *));
+    theme->missing_icons = g_hash_table_new(g_direct_hash, g_direct_equal);
+    theme->icon_cache = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                              NULL, icon_cache_entry_free);
+    theme->icon_lru = g_queue_new();
     return theme;
 }
 
@@ -442,12 +581,23 @@ icon_theme_copy(icon_theme *src)
 }
 
 
+/*
+ * Drop all decoded icons, for example when the panel size changed
+ * and other sizes are needed.
+ */
 void
-icon_theme_free(icon_theme *theme)
+icon_theme_clear_cache(icon_theme *theme)
 {
-    gchar *missing;
-    guint i;
+    if (G_UNLIKELY(theme == NULL))
+        return;
+    g_hash_table_remove_all(theme->icon_cache);
+    g_queue_clear(theme->icon_lru);
+}
+
 
+void
+icon_theme_free(icon_theme *theme)
+{
     g_assert(theme != NULL);
     if (G_UNLIKELY(theme == NULL))
         return;
@@ -456,10 +606,8 @@ icon_theme_free(icon_theme *theme)
     g_free(theme->author);
     g_free(theme->description);
     g_free(theme->license);
-    for (i = 0; i < theme->missing_icons->len; i++) {
-        missing = g_array_index(theme->missing_icons, gchar *, i);
-        g_free(missing);
-    }
-    g_array_free(theme->missing_icons, FALSE);
+    g_hash_table_destroy(theme->missing_icons);
+    g_hash_table_destroy(theme->icon_cache);
+    g_queue_free(theme->icon_lru);
     g_slice_free(icon_theme, theme);
 }
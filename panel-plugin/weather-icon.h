@@ -82,7 +82,9 @@ typedef struct {
     gchar *author;
     gchar *description;
     gchar *license;
-    GArray *missing_icons;
+    GHashTable *missing_icons;  /* icon keys of missing icon files */
+    GHashTable *icon_cache;     /* icon key -> decoded pixbuf */
+    GQueue *icon_lru;           /* icon keys, most recently used first */
 } icon_theme;
 
 
@@ -101,6 +103,8 @@ GArray *find_icon_themes(void);
 
 icon_theme *icon_theme_copy(icon_theme *src);
 
+void icon_theme_clear_cache(icon_theme *theme);
+
 void icon_theme_free(icon_theme *theme);
 
 G_END_DECLS
@@ -47,53 +47,108 @@
 
 
 /*
- * This is a portable replacement for the deprecated timegm(),
- * copied from the man page and modified to use GLIB functions.
+ * Timeslices are indexed by their (start, end) interval. The
+ * timeslices themselves serve as keys, so a lookup only needs a
+ * stack-allocated xml_time with start and end set.
  */
-static time_t
-my_timegm(struct tm *tm)
-{
-    time_t ret;
-    char *tz;
-
-    tz = g_strdup(g_getenv("TZ"));
-    g_setenv("TZ", "", 1);
-    tzset();
-    ret = mktime(tm);
-    if (tz) {
-        g_setenv("TZ", tz, 1);
-        g_free(tz);
-    }
-    else
-        g_unsetenv("TZ");
-    tzset();
-    return ret;
+static guint
+xml_time_hash(gconstpointer key)
+{
+    const xml_time *ts = key;
+    guint64 start = (guint64) ts->start, end = (guint64) ts->end;
+
+    return (guint) (start ^ (start >> 32)) * 31 + (guint) (end ^ (end >> 32));
+}
+
+
+static gboolean
+xml_time_equal(gconstpointer a,
+               gconstpointer b)
+{
+    const xml_time *ts1 = a, *ts2 = b;
+
+    return (ts1->start == ts2->start && ts1->end == ts2->end);
 }
 
 
 xml_time *
-get_timeslice(xml_weather *wd,
+get_timeslice(const xml_weather *wd,
               const time_t start_t,
-              const time_t end_t,
-              guint *index)
+              const time_t end_t)
 {
-    xml_time *timeslice;
-    gint i;
+    xml_time key;
 
     g_assert(wd != NULL);
     if (G_UNLIKELY(wd == NULL))
         return NULL;
 
-    for (i = 0; i < wd->timeslices->len; i++) {
-        timeslice = g_array_index(wd->timeslices, xml_time *, i);
-        if (timeslice &&
-            timeslice->start == start_t && timeslice->end == end_t) {
-            if (index != NULL)
-                *index = i;
-            return timeslice;
-        }
+    key.start = start_t;
+    key.end = end_t;
+    return g_hash_table_lookup(wd->ts_index, &key);
+}
+
+
+/*
+ * Add a timeslice to the lookup index. The caller is responsible for
+ * adding it to wd->timeslices as well.
+ */
+void
+xml_weather_index_add(xml_weather *wd,
+                      xml_time *timeslice)
+{
+    g_assert(wd != NULL && timeslice != NULL);
+    if (G_UNLIKELY(wd == NULL || timeslice == NULL))
+        return;
+
+    g_hash_table_replace(wd->ts_index, timeslice, timeslice);
+}
+
+
+/*
+ * Return the index of the first timeslice starting after start_t, or
+ * at start_t if inclusive is TRUE.
+ */
+static guint
+timeslice_start_position(const xml_weather *wd,
+                         const time_t start_t,
+                         const gboolean inclusive)
+{
+    xml_time *ts;
+    guint lo = 0, hi = wd->timeslices->len, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        ts = g_array_index(wd->timeslices, xml_time *, mid);
+        if (ts->start < start_t || (!inclusive && ts->start == start_t))
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    return NULL;
+    return lo;
+}
+
+
+/*
+ * Find the timeslices starting from start_min up to and including
+ * start_max. Because of the sort order, they are stored contiguously
+ * in wd->timeslices beginning at index *first. Returns their number.
+ */
+guint
+get_timeslice_range(const xml_weather *wd,
+                    const time_t start_min,
+                    const time_t start_max,
+                    guint *first)
+{
+    guint last;
+
+    g_assert(wd != NULL && first != NULL);
+    *first = 0;
+    if (G_UNLIKELY(wd == NULL) || start_max < start_min)
+        return 0;
+
+    *first = timeslice_start_position(wd, start_min, TRUE);
+    last = timeslice_start_position(wd, start_max, FALSE);
+    return (last > *first) ? last - *first : 0;
 }
 
 
@@ -121,10 +176,86 @@ get_astro(const GArray *astrodata,
 }
 
 
+/*
+ * Return the number of days since 1970-01-01 for a date in the
+ * proleptic Gregorian calendar. Taken from
+ * http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+ */
+static gint64
+days_from_civil(gint year,
+                guint month,
+                guint day)
+{
+    gint era;
+    guint yoe, doy, doe;
+
+    year -= (month <= 2);
+    era = (year >= 0 ? year : year - 399) / 400;
+    yoe = (guint) (year - era * 400);
+    doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (gint64) era * 146097 + (gint64) doe - 719468;
+}
+
+
+static gboolean
+parse_digits(const gchar *str,
+             gint len,
+             gint *result)
+{
+    gint i, val = 0;
+
+    for (i = 0; i < len; i++) {
+        if (!g_ascii_isdigit(str[i]))
+            return FALSE;
+        val = val * 10 + (str[i] - '0');
+    }
+    *result = val;
+    return TRUE;
+}
+
+
+/*
+ * Parse a UTC timestamp in the standard format used by met.no and the
+ * cache file, "YYYY-MM-DDTHH:MM:SSZ". This does neither allocate nor
+ * touch the timezone settings of the process. Returns FALSE if the
+ * string does not match that format exactly.
+ */
+static gboolean
+parse_iso8601_utc(const gchar *ts,
+                  time_t *result)
+{
+    gint year, month, day, hour, min, sec;
+
+    /* the && chain stops at the terminating zero of short strings */
+    if (!(parse_digits(ts, 4, &year) && ts[4] == '-' &&
+          parse_digits(ts + 5, 2, &month) && ts[7] == '-' &&
+          parse_digits(ts + 8, 2, &day) && ts[10] == 'T' &&
+          parse_digits(ts + 11, 2, &hour) && ts[13] == ':' &&
+          parse_digits(ts + 14, 2, &min) && ts[16] == ':' &&
+          parse_digits(ts + 17, 2, &sec) &&
+          ts[19] == 'Z' && ts[20] == '\0'))
+        return FALSE;
+
+    if (G_UNLIKELY(month < 1 || month > 12 || day < 1 || day > 31 ||
+                   hour > 23 || min > 59 || sec > 60))
+        return FALSE;
+
+    *result = (time_t) (days_from_civil(year, month, day) * 86400
+                        + hour * 3600 + min * 60 + sec);
+    return TRUE;
+}
+
+
+/*
+ * Parse a timestamp, using the given timezone if it does not contain
+ * timezone information itself, or UTC if tz is NULL.
+ */
 time_t
 parse_timestring(const gchar *ts,
                  gchar *format,
-                 gboolean local) {
+                 GTimeZone *tz) {
+    GDateTime *dt;
     time_t t;
     struct tm tm;
 
@@ -133,8 +264,11 @@ parse_timestring(const gchar *ts,
         return t;
 
     /* standard format */
-    if (format == NULL)
+    if (format == NULL) {
+        if (G_LIKELY(tz == NULL && parse_iso8601_utc(ts, &t)))
+            return t;
         format = "%Y-%m-%dT%H:%M:%SZ";
+    }
 
     /* strptime needs an initialized struct, or unpredictable
      * behaviour might occur */
@@ -144,109 +278,125 @@ parse_timestring(const gchar *ts,
     if (G_UNLIKELY(strptime(ts, format, &tm) == NULL))
         return t;
 
-    if (local)
-        t = mktime(&tm);
-    else
-        t = my_timegm(&tm);
+    if (tz == NULL)
+        return (time_t) (days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1,
+                                         tm.tm_mday) * 86400
+                         + tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec);
 
+    dt = g_date_time_new(tz, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                         tm.tm_hour, tm.tm_min, tm.tm_sec);
+    if (G_LIKELY(dt)) {
+        t = (time_t) g_date_time_to_unix(dt);
+        g_date_time_unref(dt);
+    }
     return t;
 }
 
 
+/* numeric location data, used by both the DOM and the streaming parser */
+static const struct {
+    const gchar *element;
+    const gchar *attribute;
+    location_values value;
+} location_attributes[] = {
+    { "location",      "altitude",  LOC_ALTITUDE },
+    { "location",      "latitude",  LOC_LATITUDE },
+    { "location",      "longitude", LOC_LONGITUDE },
+    { "temperature",   "value",     LOC_TEMPERATURE },
+    { "windDirection", "deg",       LOC_WIND_DIR_DEG },
+    { "windSpeed",     "mps",       LOC_WIND_SPEED_MPS },
+    { "windSpeed",     "beaufort",  LOC_WIND_SPEED_BEAUFORT },
+    { "humidity",      "value",     LOC_HUMIDITY },
+    { "pressure",      "value",     LOC_PRESSURE },
+    { "lowClouds",     "percent",   LOC_CLOUDS + CLOUDS_PERC_LOW },
+    { "mediumClouds",  "percent",   LOC_CLOUDS + CLOUDS_PERC_MID },
+    { "highClouds",    "percent",   LOC_CLOUDS + CLOUDS_PERC_HIGH },
+    { "cloudiness",    "percent",   LOC_CLOUDS + CLOUDS_PERC_CLOUDINESS },
+    { "fog",           "percent",   LOC_FOG },
+    { "precipitation", "value",     LOC_PRECIPITATION }
+};
+
+
+/*
+ * Store a numeric attribute value in the location values, marking
+ * it invalid if the attribute is missing or empty.
+ */
 static void
-parse_location(xmlNode *cur_node,
-               xml_location *loc)
+set_location_value(xml_location *loc,
+                   const location_values v,
+                   const gchar *str)
 {
-    xmlNode *child_node;
+    if (str && *str)
+        LOC_SET(loc, v, g_ascii_strtod(str, NULL));
+    else
+        LOC_UNSET(loc, v);
+}
 
-    g_free(loc->altitude);
-    loc->altitude = PROP(cur_node, "altitude");
 
-    g_free(loc->latitude);
-    loc->latitude = PROP(cur_node, "latitude");
+/*
+ * Convert Fahrenheit to Celsius if necessary, so that we don't have
+ * to do it later. met.no usually provides values in Celsius.
+ */
+static void
+set_location_temperature_unit(xml_location *loc,
+                              const gchar *unit)
+{
+    if (unit && LOC_HAS(loc, LOC_TEMPERATURE) && !strcmp(unit, "fahrenheit"))
+        loc->values[LOC_TEMPERATURE] =
+            (loc->values[LOC_TEMPERATURE] - 32.0) * 5.0 / 9.0;
+}
 
-    g_free(loc->longitude);
-    loc->longitude = PROP(cur_node, "longitude");
 
-    for (child_node = cur_node->children; child_node;
-         child_node = child_node->next) {
-        if (NODE_IS_TYPE(child_node, "temperature")) {
-            g_free(loc->temperature_unit);
-            g_free(loc->temperature_value);
-            loc->temperature_unit = PROP(child_node, "unit");
-            loc->temperature_value = PROP(child_node, "value");
-        }
-        if (NODE_IS_TYPE(child_node, "windDirection")) {
-            g_free(loc->wind_dir_deg);
-            g_free(loc->wind_dir_name);
-            loc->wind_dir_deg = PROP(child_node, "deg");
-            loc->wind_dir_name = PROP(child_node, "name");
-        }
-        if (NODE_IS_TYPE(child_node, "windSpeed")) {
-            g_free(loc->wind_speed_mps);
-            g_free(loc->wind_speed_beaufort);
-            loc->wind_speed_mps = PROP(child_node, "mps");
-            loc->wind_speed_beaufort = PROP(child_node, "beaufort");
-        }
-        if (NODE_IS_TYPE(child_node, "humidity")) {
-            g_free(loc->humidity_unit);
-            g_free(loc->humidity_value);
-            loc->humidity_unit = PROP(child_node, "unit");
-            loc->humidity_value = PROP(child_node, "value");
-        }
-        if (NODE_IS_TYPE(child_node, "pressure")) {
-            g_free(loc->pressure_unit);
-            g_free(loc->pressure_value);
-            loc->pressure_unit = PROP(child_node, "unit");
-            loc->pressure_value = PROP(child_node, "value");
-        }
-        if (NODE_IS_TYPE(child_node, "cloudiness")) {
-            g_free(loc->clouds_percent[CLOUDS_PERC_CLOUDINESS]);
-            loc->clouds_percent[CLOUDS_PERC_CLOUDINESS] = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "fog")) {
-            g_free(loc->fog_percent);
-            loc->fog_percent = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "lowClouds")) {
-            g_free(loc->clouds_percent[CLOUDS_PERC_LOW]);
-            loc->clouds_percent[CLOUDS_PERC_LOW] = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "mediumClouds")) {
-            g_free(loc->clouds_percent[CLOUDS_PERC_MID]);
-            loc->clouds_percent[CLOUDS_PERC_MID] = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "highClouds")) {
-            g_free(loc->clouds_percent[CLOUDS_PERC_HIGH]);
-            loc->clouds_percent[CLOUDS_PERC_HIGH] = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "precipitation")) {
-            g_free(loc->precipitation_unit);
-            g_free(loc->precipitation_value);
-            loc->precipitation_unit = PROP(child_node, "unit");
-            loc->precipitation_value = PROP(child_node, "value");
-        }
-        if (NODE_IS_TYPE(child_node, "symbol")) {
-            g_free(loc->symbol);
-            loc->symbol_id = strtol(PROP(child_node, "number"), NULL, 10);
-            loc->symbol = g_strdup(get_symbol_for_id(loc->symbol_id));
+static void
+set_location_symbol(xml_location *loc,
+                    const gchar *number)
+{
+    if (number)
+        LOC_SET_SYMBOL(loc, normalize_symbol_id(strtol(number, NULL, 10)));
+}
+
+
+static void
+parse_location_node(xmlNode *cur_node,
+                    xml_location *loc)
+{
+    gchar *str;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(location_attributes); i++)
+        if (NODE_IS_TYPE(cur_node, location_attributes[i].element)) {
+            str = PROP(cur_node, location_attributes[i].attribute);
+            set_location_value(loc, location_attributes[i].value, str);
+            xmlFree(str);
         }
-    }
 
-    /* Convert Fahrenheit to Celsius if necessary, so that we don't
-       have to do it later. met.no usually provides values in Celsius. */
-    if (loc->temperature_value && loc->temperature_unit &&
-        !strcmp(loc->temperature_unit, "fahrenheit")) {
-        gdouble val = string_to_double(loc->temperature_value, 0);
-        val = (val - 32.0) * 5.0 / 9.0;
-        g_free(loc->temperature_value);
-        loc->temperature_value = double_to_string(val, "%.1f");
-        g_free(loc->temperature_unit);
-        loc->temperature_unit = g_strdup("celsius");
+    if (NODE_IS_TYPE(cur_node, "temperature")) {
+        str = PROP(cur_node, "unit");
+        set_location_temperature_unit(loc, str);
+        xmlFree(str);
+    }
+    if (NODE_IS_TYPE(cur_node, "symbol")) {
+        str = PROP(cur_node, "number");
+        set_location_symbol(loc, str);
+        xmlFree(str);
     }
 }
 
 
+static void
+parse_location(xmlNode *cur_node,
+               xml_location *loc)
+{
+    xmlNode *child_node;
+
+    parse_location_node(cur_node, loc);
+    for (child_node = cur_node->children; child_node;
+         child_node = child_node->next)
+        if (child_node->type == XML_ELEMENT_NODE)
+            parse_location_node(child_node, loc);
+}
+
+
 xml_weather *
 make_weather_data(void)
 {
@@ -261,6 +411,7 @@ make_weather_data(void)
         g_slice_free(xml_weather, wd);
         return NULL;
     }
+    wd->ts_index = g_hash_table_new(xml_time_hash, xml_time_equal);
     return wd;
 }
 
@@ -279,10 +430,24 @@ make_timeslice(void)
         g_slice_free(xml_time, timeslice);
         return NULL;
     }
+    timeslice->ref_count = 1;
     return timeslice;
 }
 
 
+xml_astro *
+make_astro(void)
+{
+    xml_astro *astro;
+
+    astro = g_slice_new0(xml_astro);
+    if (G_UNLIKELY(astro == NULL))
+        return NULL;
+    astro->ref_count = 1;
+    return astro;
+}
+
+
 static void
 parse_time(xmlNode *cur_node,
            xml_weather *wd)
@@ -300,18 +465,18 @@ parse_time(xmlNode *cur_node,
     xmlFree(datatype);
 
     from = PROP(cur_node, "from");
-    start_t = parse_timestring(from, NULL, FALSE);
+    start_t = parse_timestring(from, NULL, NULL);
     xmlFree(from);
 
     to = PROP(cur_node, "to");
-    end_t = parse_timestring(to, NULL, FALSE);
+    end_t = parse_timestring(to, NULL, NULL);
     xmlFree(to);
 
     if (G_UNLIKELY(!start_t || !end_t))
         return;
 
     /* look for existing timeslice or add a new one */
-    timeslice = get_timeslice(wd, start_t, end_t, NULL);
+    timeslice = get_timeslice(wd, start_t, end_t);
     if (! timeslice) {
         timeslice = make_timeslice();
         if (G_UNLIKELY(!timeslice))
@@ -319,6 +484,7 @@ parse_time(xmlNode *cur_node,
         timeslice->start = start_t;
         timeslice->end = end_t;
         g_array_append_val(wd->timeslices, timeslice);
+        xml_weather_index_add(wd, timeslice);
     }
 
     for (child_node = cur_node->children; child_node;
@@ -328,6 +494,19 @@ parse_time(xmlNode *cur_node,
 }
 
 
+/*
+ * A forecast may be made of several models, new data will be
+ * available when the first of them has been run again.
+ */
+static void
+update_next_run(xml_weather *wd,
+                const time_t next_run)
+{
+    if (next_run > 0 && (wd->next_run == 0 || next_run < wd->next_run))
+        wd->next_run = next_run;
+}
+
+
 /*
  * Parse XML weather data and merge it with current data.
  */
@@ -348,6 +527,17 @@ parse_weather(xmlNode *cur_node,
         if (cur_node->type != XML_ELEMENT_NODE)
             continue;
 
+        if (NODE_IS_TYPE(cur_node, "meta")) {
+            for (child_node = cur_node->children; child_node;
+                 child_node = child_node->next)
+                if (NODE_IS_TYPE(child_node, "model")) {
+                    gchar *nextrun = PROP(child_node, "nextrun");
+                    update_next_run(wd, parse_timestring(nextrun,
+                                                         NULL, NULL));
+                    xmlFree(nextrun);
+                }
+        }
+
         if (NODE_IS_TYPE(cur_node, "product")) {
             gchar *class = PROP(cur_node, "class");
             if (xmlStrcasecmp((xmlChar *) class, (xmlChar *) "pointData")) {
@@ -365,6 +555,302 @@ parse_weather(xmlNode *cur_node,
 }
 
 
+/*
+ * Streaming parser for locationforecast documents. Instead of
+ * building a DOM tree, SAX callbacks fill in a single <time> element
+ * at a time, which is added to the weather data when the element is
+ * complete. Input can be fed in arbitrary chunks. Timeslices are kept
+ * in document order, merge_weather() sorts them when merging.
+ */
+typedef enum {
+    WP_LEVEL_NONE = 0,
+    WP_LEVEL_WEATHERDATA,
+    WP_LEVEL_PRODUCT,
+    WP_LEVEL_TIME,
+    WP_LEVEL_LOCATION
+} weather_parser_level;
+
+struct _weather_parser {
+    xmlParserCtxtPtr ctxt;
+    xml_weather *wd;
+    gint depth;                   /* depth of the current element */
+    weather_parser_level level;   /* innermost element we are inside of */
+    gboolean found_root;
+    gboolean in_meta;             /* inside <meta> instead of <product> */
+    xml_time *existing;           /* timeslice that is being updated */
+    xml_time time;                /* data of the current <time> element */
+    xml_location location;
+};
+
+
+/*
+ * Copy the value of a SAX2 attribute into buf, returning NULL if
+ * there is no attribute with that name. SAX2 attribute values are
+ * not zero-terminated.
+ */
+static const gchar *
+sax_attribute(const xmlChar **attributes,
+              const gint nb_attributes,
+              const gchar *name,
+              gchar *buf,
+              const gsize size)
+{
+    gsize len;
+    gint i;
+
+    for (i = 0; i < nb_attributes; i++, attributes += 5)
+        if (xmlStrEqual(attributes[0], (const xmlChar *) name)) {
+            len = attributes[4] - attributes[3];
+            if (len >= size)
+                len = size - 1;
+            memcpy(buf, attributes[3], len);
+            buf[len] = '\0';
+            return buf;
+        }
+    return NULL;
+}
+
+
+static void
+weather_parser_location_element(weather_parser *parser,
+                                const xmlChar *name,
+                                const xmlChar **attributes,
+                                const gint nb_attributes)
+{
+    xml_location *loc = &parser->location;
+    gchar buf[64];
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(location_attributes); i++)
+        if (xmlStrEqual(name, (const xmlChar *) location_attributes[i].element))
+            set_location_value(loc, location_attributes[i].value,
+                               sax_attribute(attributes, nb_attributes,
+                                             location_attributes[i].attribute,
+                                             buf, sizeof(buf)));
+
+    if (xmlStrEqual(name, (const xmlChar *) "temperature"))
+        set_location_temperature_unit(loc,
+                                      sax_attribute(attributes, nb_attributes,
+                                                    "unit", buf, sizeof(buf)));
+    else if (xmlStrEqual(name, (const xmlChar *) "symbol"))
+        set_location_symbol(loc, sax_attribute(attributes, nb_attributes,
+                                               "number", buf, sizeof(buf)));
+}
+
+
+static void
+weather_parser_start_element(void *ctx,
+                             const xmlChar *name,
+                             const xmlChar *prefix,
+                             const xmlChar *uri,
+                             int nb_namespaces,
+                             const xmlChar **namespaces,
+                             int nb_attributes,
+                             int nb_defaulted,
+                             const xmlChar **attributes)
+{
+    weather_parser *parser = ctx;
+    gchar buf[64];
+    const gchar *str;
+
+    parser->depth++;
+
+    /* only direct children of the innermost element we are in matter */
+    if (parser->depth != parser->level + 1)
+        return;
+
+    switch (parser->level) {
+    case WP_LEVEL_NONE:
+        if (!xmlStrEqual(name, (const xmlChar *) "weatherdata"))
+            return;
+        parser->found_root = TRUE;
+        break;
+
+    case WP_LEVEL_WEATHERDATA:
+        /* <meta> is a sibling of <product>, so it shares its level */
+        if (xmlStrEqual(name, (const xmlChar *) "meta")) {
+            parser->in_meta = TRUE;
+            break;
+        }
+        if (!xmlStrEqual(name, (const xmlChar *) "product"))
+            return;
+        str = sax_attribute(attributes, nb_attributes, "class",
+                            buf, sizeof(buf));
+        if (xmlStrcasecmp((xmlChar *) str, (xmlChar *) "pointData"))
+            return;
+        break;
+
+    case WP_LEVEL_PRODUCT:
+        if (parser->in_meta) {
+            if (xmlStrEqual(name, (const xmlChar *) "model"))
+                update_next_run(parser->wd, parse_timestring
+                                (sax_attribute(attributes, nb_attributes,
+                                               "nextrun", buf, sizeof(buf)),
+                                 NULL, NULL));
+            return;
+        }
+        if (!xmlStrEqual(name, (const xmlChar *) "time"))
+            return;
+        str = sax_attribute(attributes, nb_attributes, "datatype",
+                            buf, sizeof(buf));
+        if (xmlStrcasecmp((xmlChar *) str, (xmlChar *) "forecast"))
+            return;
+        parser->time.start =
+            parse_timestring(sax_attribute(attributes, nb_attributes, "from",
+                                           buf, sizeof(buf)), NULL, NULL);
+        parser->time.end =
+            parse_timestring(sax_attribute(attributes, nb_attributes, "to",
+                                           buf, sizeof(buf)), NULL, NULL);
+        if (G_UNLIKELY(!parser->time.start || !parser->time.end))
+            return;
+
+        /* update existing timeslice or start with empty data */
+        parser->existing = get_timeslice(parser->wd, parser->time.start,
+                                         parser->time.end);
+        if (parser->existing)
+            parser->location = *parser->existing->location;
+        else
+            memset(&parser->location, 0, sizeof(xml_location));
+        break;
+
+    case WP_LEVEL_TIME:
+        if (!xmlStrEqual(name, (const xmlChar *) "location"))
+            return;
+        weather_parser_location_element(parser, name,
+                                        attributes, nb_attributes);
+        break;
+
+    case WP_LEVEL_LOCATION:
+        /* leaf elements with the actual data */
+        weather_parser_location_element(parser, name,
+                                        attributes, nb_attributes);
+        return;
+    }
+    parser->level++;
+}
+
+
+static void
+weather_parser_end_element(void *ctx,
+                           const xmlChar *name,
+                           const xmlChar *prefix,
+                           const xmlChar *uri)
+{
+    weather_parser *parser = ctx;
+    xml_time *timeslice;
+
+    if (parser->depth-- != parser->level)
+        return;
+
+    if (parser->level == WP_LEVEL_TIME) {
+        /* <time> element is complete, merge its data */
+        if (parser->existing)
+            *parser->existing->location = parser->location;
+        else if (G_LIKELY((timeslice = make_timeslice()))) {
+            timeslice->start = parser->time.start;
+            timeslice->end = parser->time.end;
+            *timeslice->location = parser->location;
+            g_array_append_val(parser->wd->timeslices, timeslice);
+            xml_weather_index_add(parser->wd, timeslice);
+        }
+        parser->existing = NULL;
+    } else if (parser->level == WP_LEVEL_PRODUCT)
+        parser->in_meta = FALSE;
+    parser->level--;
+}
+
+
+weather_parser *
+make_weather_parser(xml_weather *wd)
+{
+    weather_parser *parser;
+    xmlSAXHandler sax;
+
+    g_assert(wd != NULL);
+    if (G_UNLIKELY(wd == NULL))
+        return NULL;
+
+    parser = g_slice_new0(weather_parser);
+    if (G_UNLIKELY(parser == NULL))
+        return NULL;
+    parser->wd = wd;
+
+    memset(&sax, 0, sizeof(xmlSAXHandler));
+    sax.initialized = XML_SAX2_MAGIC;
+    sax.startElementNs = weather_parser_start_element;
+    sax.endElementNs = weather_parser_end_element;
+
+    parser->ctxt = xmlCreatePushParserCtxt(&sax, parser, NULL, 0, NULL);
+    if (G_UNLIKELY(parser->ctxt == NULL)) {
+        g_slice_free(weather_parser, parser);
+        return NULL;
+    }
+    xmlCtxtUseOptions(parser->ctxt, XML_PARSE_NONET);
+    return parser;
+}
+
+
+/*
+ * Feed the next chunk of the document to the parser. Returns FALSE
+ * if the document is not well-formed.
+ */
+gboolean
+weather_parser_feed(weather_parser *parser,
+                    const gchar *chunk,
+                    const gsize len)
+{
+    g_assert(parser != NULL);
+    if (G_UNLIKELY(parser == NULL))
+        return FALSE;
+
+    return (xmlParseChunk(parser->ctxt, chunk, (int) len, 0) == 0);
+}
+
+
+/*
+ * Finish parsing and free the parser. Returns TRUE if a complete,
+ * well-formed weatherdata document has been parsed.
+ */
+gboolean
+weather_parser_finish(weather_parser *parser)
+{
+    gboolean result;
+
+    g_assert(parser != NULL);
+    if (G_UNLIKELY(parser == NULL))
+        return FALSE;
+
+    xmlParseChunk(parser->ctxt, NULL, 0, 1);
+    result = (parser->found_root && parser->ctxt->wellFormed);
+    xmlFreeParserCtxt(parser->ctxt);
+    g_slice_free(weather_parser, parser);
+    return result;
+}
+
+
+/*
+ * Parse a complete locationforecast document from memory and merge
+ * it with current data, without building a DOM tree.
+ */
+gboolean
+parse_weather_stream(const gchar *buf,
+                     const gsize len,
+                     xml_weather *wd)
+{
+    weather_parser *parser;
+
+    if (G_UNLIKELY(buf == NULL || len == 0))
+        return FALSE;
+
+    parser = make_weather_parser(wd);
+    if (G_UNLIKELY(parser == NULL))
+        return FALSE;
+
+    weather_parser_feed(parser, buf, len);
+    return weather_parser_finish(parser);
+}
+
+
 static void
 parse_astro_location(xmlNode *cur_node,
                      xml_astro *astro)
@@ -395,11 +881,11 @@ parse_astro_location(xmlNode *cur_node,
             xmlFree(never_sets);
 
             sunrise = PROP(child_node, "rise");
-            astro->sunrise = parse_timestring(sunrise, NULL, FALSE);
+            astro->sunrise = parse_timestring(sunrise, NULL, NULL);
             xmlFree(sunrise);
 
             sunset = PROP(child_node, "set");
-            astro->sunset = parse_timestring(sunset, NULL, FALSE);
+            astro->sunset = parse_timestring(sunset, NULL, NULL);
             xmlFree(sunset);
         }
 
@@ -423,11 +909,11 @@ parse_astro_location(xmlNode *cur_node,
             xmlFree(never_sets);
 
             moonrise = PROP(child_node, "rise");
-            astro->moonrise = parse_timestring(moonrise, NULL, FALSE);
+            astro->moonrise = parse_timestring(moonrise, NULL, NULL);
             xmlFree(moonrise);
 
             moonset = PROP(child_node, "set");
-            astro->moonset = parse_timestring(moonset, NULL, FALSE);
+            astro->moonset = parse_timestring(moonset, NULL, NULL);
             xmlFree(moonset);
 
             astro->moon_phase = PROP(child_node, "phase");
@@ -437,18 +923,19 @@ parse_astro_location(xmlNode *cur_node,
 
 
 static xml_astro *
-parse_astro_time(xmlNode *cur_node)
+parse_astro_time(xmlNode *cur_node,
+                 GTimeZone *tz)
 {
     xmlNode *child_node;
     xml_astro *astro;
     gchar *date;
 
-    astro = g_slice_new0(xml_astro);
+    astro = make_astro();
     if (G_UNLIKELY(astro == NULL))
         return NULL;
 
     date = PROP(cur_node, "date");
-    astro->day = parse_timestring(date, "%Y-%m-%d", TRUE);
+    astro->day = parse_timestring(date, "%Y-%m-%d", tz);
     xmlFree(date);
 
     for (child_node = cur_node->children; child_node;
@@ -465,7 +952,8 @@ parse_astro_time(xmlNode *cur_node)
  */
 gboolean
 parse_astrodata(xmlNode *cur_node,
-                GArray *astrodata)
+                GArray *astrodata,
+                GTimeZone *tz)
 {
     xmlNode *child_node;
     xml_astro *astro;
@@ -481,10 +969,8 @@ parse_astrodata(xmlNode *cur_node,
     for (child_node = cur_node->children; child_node;
          child_node = child_node->next)
         if (NODE_IS_TYPE(child_node, "time")) {
-            if ((astro = parse_astro_time(child_node))) {
+            if ((astro = parse_astro_time(child_node, tz)))
                 merge_astro(astrodata, astro);
-                xml_astro_free(astro);
-            }
         }
     return TRUE;
 }
@@ -640,131 +1126,69 @@ xml_location_free(xml_location *loc)
     g_assert(loc != NULL);
     if (G_UNLIKELY(loc == NULL))
         return;
-    g_free(loc->altitude);
-    g_free(loc->latitude);
-    g_free(loc->longitude);
-    g_free(loc->temperature_value);
-    g_free(loc->temperature_unit);
-    g_free(loc->wind_dir_deg);
-    g_free(loc->wind_dir_name);
-    g_free(loc->wind_speed_mps);
-    g_free(loc->wind_speed_beaufort);
-    g_free(loc->humidity_value);
-    g_free(loc->humidity_unit);
-    g_free(loc->pressure_value);
-    g_free(loc->pressure_unit);
-    g_free(loc->clouds_percent[CLOUDS_PERC_LOW]);
-    g_free(loc->clouds_percent[CLOUDS_PERC_MID]);
-    g_free(loc->clouds_percent[CLOUDS_PERC_HIGH]);
-    g_free(loc->clouds_percent[CLOUDS_PERC_CLOUDINESS]);
-    g_free(loc->fog_percent);
-    g_free(loc->precipitation_value);
-    g_free(loc->precipitation_unit);
-    g_free(loc->symbol);
     g_slice_free(xml_location, loc);
 }
 
 
-/*
- * Deep copy xml_astro struct.
- */
 xml_astro *
-xml_astro_copy(const xml_astro *src)
+xml_astro_ref(xml_astro *astro)
 {
-    xml_astro *dst;
-
-    if (G_UNLIKELY(src == NULL))
+    g_assert(astro != NULL);
+    if (G_UNLIKELY(astro == NULL))
         return NULL;
+    g_atomic_int_inc(&astro->ref_count);
+    return astro;
+}
 
-    dst = g_slice_new0(xml_astro);
-    g_assert(dst != NULL);
-    if (G_UNLIKELY(dst == NULL))
-        return NULL;
 
-    dst->day = src->day;
-    dst->sunrise = src->sunrise;
-    dst->sunset = src->sunset;
-    dst->sun_never_rises = src->sun_never_rises;
-    dst->sun_never_sets = src->sun_never_sets;
-    dst->moonrise = src->moonrise;
-    dst->moonset = src->moonset;
-    dst->moon_never_rises = src->moon_never_rises;
-    dst->moon_never_sets = src->moon_never_sets;
-    dst->moon_phase = g_strdup(src->moon_phase);
-    return dst;
+xml_time *
+xml_time_ref(xml_time *timeslice)
+{
+    g_assert(timeslice != NULL);
+    if (G_UNLIKELY(timeslice == NULL))
+        return NULL;
+    g_atomic_int_inc(&timeslice->ref_count);
+    return timeslice;
 }
 
 
 /*
- * Deep copy xml_time struct.
+ * Copy xml_weather, sharing its timeslices, but not the current
+ * conditions, which depend on the time they are calculated for.
  */
-xml_time *
-xml_time_copy(const xml_time *src)
+xml_weather *
+xml_weather_copy(const xml_weather *src)
 {
-    xml_time *dst;
-    xml_location *loc;
-    gint i;
+    xml_weather *dst;
+    xml_time *timeslice;
+    guint i;
 
     if (G_UNLIKELY(src == NULL))
         return NULL;
 
-    dst = g_slice_new0(xml_time);
-    g_assert(dst != NULL);
+    dst = make_weather_data();
     if (G_UNLIKELY(dst == NULL))
         return NULL;
 
-    loc = g_slice_new0(xml_location);
-    g_assert(loc != NULL);
-    if (loc == NULL) {
-        g_slice_free(xml_time, dst);
-        return NULL;
+    /* already sorted, so appending keeps the order */
+    for (i = 0; i < src->timeslices->len; i++) {
+        timeslice = xml_time_ref(g_array_index(src->timeslices,
+                                               xml_time *, i));
+        g_array_append_val(dst->timeslices, timeslice);
+        xml_weather_index_add(dst, timeslice);
     }
-
-    dst->start = src->start;
-    dst->end = src->end;
-
-    loc->altitude = g_strdup(src->location->altitude);
-    loc->latitude = g_strdup(src->location->latitude);
-    loc->longitude = g_strdup(src->location->longitude);
-
-    loc->temperature_value = g_strdup(src->location->temperature_value);
-    loc->temperature_unit = g_strdup(src->location->temperature_unit);
-
-    loc->wind_dir_deg = g_strdup(src->location->wind_dir_deg);
-    loc->wind_dir_name = g_strdup(src->location->wind_dir_name);
-    loc->wind_speed_mps = g_strdup(src->location->wind_speed_mps);
-    loc->wind_speed_beaufort = g_strdup(src->location->wind_speed_beaufort);
-
-    loc->humidity_value = g_strdup(src->location->humidity_value);
-    loc->humidity_unit = g_strdup(src->location->humidity_unit);
-
-    loc->pressure_value = g_strdup(src->location->pressure_value);
-    loc->pressure_unit = g_strdup(src->location->pressure_unit);
-
-    for (i = 0; i < CLOUDS_PERC_NUM; i++)
-        loc->clouds_percent[i] = g_strdup(src->location->clouds_percent[i]);
-
-    loc->fog_percent = g_strdup(src->location->fog_percent);
-
-    loc->precipitation_value =
-        g_strdup(src->location->precipitation_value);
-    loc->precipitation_unit = g_strdup(src->location->precipitation_unit);
-
-    loc->symbol_id = src->location->symbol_id;
-    loc->symbol = g_strdup(src->location->symbol);
-
-    dst->location = loc;
-
     return dst;
 }
 
 
 void
-xml_time_free(xml_time *timeslice)
+xml_time_unref(xml_time *timeslice)
 {
     g_assert(timeslice != NULL);
     if (G_UNLIKELY(timeslice == NULL))
         return;
+    if (!g_atomic_int_dec_and_test(&timeslice->ref_count))
+        return;
     xml_location_free(timeslice->location);
     g_slice_free(xml_time, timeslice);
 }
@@ -783,48 +1207,60 @@ xml_weather_free(xml_weather *wd)
         weather_debug("Freeing %u timeslices.", wd->timeslices->len);
         for (i = 0; i < wd->timeslices->len; i++) {
             timeslice = g_array_index(wd->timeslices, xml_time *, i);
-            xml_time_free(timeslice);
+            xml_time_unref(timeslice);
         }
-        g_array_free(wd->timeslices, FALSE);
+        g_array_free(wd->timeslices, TRUE);
     }
+    if (G_LIKELY(wd->ts_index))
+        g_hash_table_destroy(wd->ts_index);
     if (G_LIKELY(wd->current_conditions)) {
         weather_debug("Freeing current conditions.");
-        xml_time_free(wd->current_conditions);
+        xml_time_unref(wd->current_conditions);
     }
     g_slice_free(xml_weather, wd);
 }
 
 
+/*
+ * Remove expired timeslices in a single pass, moving the remaining
+ * ones to the front so that their order is preserved.
+ */
 void
 xml_weather_clean(xml_weather *wd)
 {
     xml_time *timeslice;
     time_t now_t = time(NULL);
-    gint i;
+    guint i, j;
 
     if (G_UNLIKELY(wd == NULL || wd->timeslices == NULL))
         return;
-    for (i = 0; i < wd->timeslices->len; i++) {
+    for (i = 0, j = 0; i < wd->timeslices->len; i++) {
         timeslice = g_array_index(wd->timeslices, xml_time *, i);
         if (G_UNLIKELY(timeslice == NULL))
             continue;
         if (difftime(now_t, timeslice->end) > DATA_EXPIRY_TIME) {
             weather_debug("Removing expired timeslice:");
             weather_dump(weather_dump_timeslice, timeslice);
-            xml_time_free(timeslice);
-            g_array_remove_index(wd->timeslices, i--);
-            weather_debug("Remaining timeslices: %d", wd->timeslices->len);
-        }
+            g_hash_table_remove(wd->ts_index, timeslice);
+            xml_time_unref(timeslice);
+        } else
+            g_array_index(wd->timeslices, xml_time *, j++) = timeslice;
+    }
+    if (j < wd->timeslices->len) {
+        g_array_set_size(wd->timeslices, j);
+        weather_debug("Remaining timeslices: %d", wd->timeslices->len);
     }
 }
 
 
 void
-xml_astro_free(xml_astro *astro)
+xml_astro_unref(xml_astro *astro)
 {
     g_assert(astro != NULL);
     if (G_UNLIKELY(astro == NULL))
         return;
+    if (!g_atomic_int_dec_and_test(&astro->ref_count))
+        return;
     g_free(astro->moon_phase);
     g_slice_free(xml_astro, astro);
 }
@@ -841,9 +1277,9 @@ astrodata_free(GArray *astrodata)
     for (i = 0; i < astrodata->len; i++) {
         astro = g_array_index(astrodata, xml_astro *, i);
         if (astro)
-            xml_astro_free(astro);
+            xml_astro_unref(astro);
     }
-    g_array_free(astrodata, FALSE);
+    g_array_free(astrodata, TRUE);
 }
 
 
@@ -36,47 +36,79 @@ enum {
     CLOUDS_PERC_NUM
 };
 
+/*
+ * Indices into xml_location->values. All values are stored in the
+ * units delivered by met.no (meters, degrees, °C, m/s, %, hPa, mm);
+ * conversion to the units chosen by the user is done on output.
+ */
+typedef enum {
+    LOC_ALTITUDE = 0,
+    LOC_LATITUDE,
+    LOC_LONGITUDE,
+    LOC_TEMPERATURE,
+    LOC_WIND_DIR_DEG,
+    LOC_WIND_SPEED_MPS,
+    LOC_WIND_SPEED_BEAUFORT,
+    LOC_HUMIDITY,
+    LOC_PRESSURE,
+    LOC_CLOUDS,         /* CLOUDS_PERC_NUM entries, see above */
+    LOC_FOG = LOC_CLOUDS + CLOUDS_PERC_NUM,
+    LOC_PRECIPITATION,
+    LOC_VALUES_NUM,
+    /* validity flag only, the id itself is stored in symbol_id */
+    LOC_SYMBOL = LOC_VALUES_NUM
+} location_values;
+
+#define LOC_HAS(loc, v)                         \
+    (((loc)->valid & (1U << (v))) != 0)
+
+#define LOC_SET(loc, v, val)                    \
+    do {                                        \
+        (loc)->values[(v)] = (val);             \
+        (loc)->valid |= (1U << (v));            \
+    } while (0)
+
+#define LOC_UNSET(loc, v)                       \
+    do {                                        \
+        (loc)->values[(v)] = 0;                 \
+        (loc)->valid &= ~(1U << (v));           \
+    } while (0)
+
+#define LOC_SET_SYMBOL(loc, id)                 \
+    do {                                        \
+        (loc)->symbol_id = (id);                \
+        (loc)->valid |= (1U << LOC_SYMBOL);     \
+    } while (0)
+
 typedef gpointer (*XmlParseFunc) (xmlNode *node);
 
 typedef struct {
-    gchar *altitude;
-    gchar *latitude;
-    gchar *longitude;
-
-    gchar *temperature_value;
-    gchar *temperature_unit;
-
-    gchar *wind_dir_deg;
-    gchar *wind_dir_name;
-    gchar *wind_speed_mps;
-    gchar *wind_speed_beaufort;
-
-    gchar *humidity_value;
-    gchar *humidity_unit;
-
-    gchar *pressure_value;
-    gchar *pressure_unit;
-
-    gchar *clouds_percent[CLOUDS_PERC_NUM];
-    gchar *fog_percent;
-
-    gchar *precipitation_value;
-    gchar *precipitation_unit;
+    /* unset values are 0 and have their bit cleared in valid */
+    gdouble values[LOC_VALUES_NUM];
+    guint32 valid;
 
+    /* one of symbol_ids, already mapped from the met.no numbering */
     gint symbol_id;
-    gchar *symbol;
 } xml_location;
 
+/*
+ * Timeslices and astrodata are reference counted and must not be
+ * changed once they have been added to data that may be shared.
+ */
 typedef struct {
     time_t start;
     time_t end;
     time_t point;
     xml_location *location;
+    gint ref_count;
 } xml_time;
 
 typedef struct {
-    GArray *timeslices;
+    GArray *timeslices;         /* sorted by start, then end time,
+                                   unless freshly parsed */
+    GHashTable *ts_index;       /* xml_time (start, end) -> xml_time */
     xml_time *current_conditions;
+    time_t next_run;            /* earliest next model run, 0 if unknown */
 } xml_weather;
 
 typedef struct {
@@ -92,8 +124,11 @@ typedef struct {
     gboolean moon_never_rises;
     gboolean moon_never_sets;
     gchar *moon_phase;
+    gint ref_count;
 } xml_astro;
 
+typedef struct _weather_parser weather_parser;
+
 typedef struct {
     gchar *city;
     gchar *country_name;
@@ -124,17 +159,32 @@ xml_weather *make_weather_data(void);
 
 xml_time *make_timeslice(void);
 
+xml_astro *make_astro(void);
+
 time_t parse_timestring(const gchar *ts,
                         gchar *format,
-                        gboolean local);
+                        GTimeZone *tz);
 
 gboolean parse_weather(xmlNode *cur_node,
                        xml_weather *wd);
 
+weather_parser *make_weather_parser(xml_weather *wd);
+
+gboolean weather_parser_feed(weather_parser *parser,
+                             const gchar *chunk,
+                             gsize len);
+
+gboolean weather_parser_finish(weather_parser *parser);
+
+gboolean parse_weather_stream(const gchar *buf,
+                              gsize len,
+                              xml_weather *wd);
+
 xml_astro *parse_astro(xmlNode *cur_node);
 
 gboolean parse_astrodata(xmlNode *cur_node,
-                         GArray *astrodata);
+                         GArray *astrodata,
+                         GTimeZone *tz);
 
 xml_geolocation *parse_geolocation(xmlNode *cur_node);
 
@@ -144,10 +194,17 @@ xml_altitude *parse_altitude(xmlNode *cur_node);
 
 xml_timezone *parse_timezone(xmlNode *cur_node);
 
-xml_time *get_timeslice(xml_weather *wd,
+xml_time *get_timeslice(const xml_weather *wd,
                         const time_t start_t,
-                        const time_t end_t,
-                        guint *index);
+                        const time_t end_t);
+
+void xml_weather_index_add(xml_weather *wd,
+                           xml_time *timeslice);
+
+guint get_timeslice_range(const xml_weather *wd,
+                          time_t start_min,
+                          time_t start_max,
+                          guint *first);
 
 xml_astro *get_astro(const GArray *astrodata,
                      const time_t day_t,
@@ -158,17 +215,19 @@ xmlDoc *get_xml_document(SoupMessage *msg);
 gpointer parse_xml_document(SoupMessage *msg,
                             XmlParseFunc parse_func);
 
-xml_astro *xml_astro_copy(const xml_astro *src);
+xml_astro *xml_astro_ref(xml_astro *astro);
+
+xml_time *xml_time_ref(xml_time *timeslice);
 
-xml_time *xml_time_copy(const xml_time *src);
+xml_weather *xml_weather_copy(const xml_weather *src);
 
-void xml_time_free(xml_time *timeslice);
+void xml_time_unref(xml_time *timeslice);
 
 void xml_weather_free(xml_weather *wd);
 
 void xml_weather_clean(xml_weather *wd);
 
-void xml_astro_free(xml_astro *astro);
+void xml_astro_unref(xml_astro *astro);
 
 void astrodata_free(GArray *astrodata);
 
@@ -0,0 +1,414 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <libxfce4util/libxfce4util.h>
+#include <gio/gio.h>
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#include "weather-scheduler.h"
+#include "weather-debug.h"
+
+#define LOGIND_NAME "org.freedesktop.login1"
+#define LOGIND_PATH "/org/freedesktop/login1"
+#define LOGIND_MANAGER_IFACE "org.freedesktop.login1.Manager"
+
+static const gchar *wakeup_names[WAKEUP_NUM] = {
+    [WAKEUP_ASTRO_DOWNLOAD] = "astro data download",
+    [WAKEUP_WEATHER_DOWNLOAD] = "weather data download",
+    [WAKEUP_CONDITIONS_UPDATE] = "current conditions update",
+    [WAKEUP_SUNRISE] = "sunrise icon change",
+    [WAKEUP_SUNSET] = "sunset icon change",
+    [WAKEUP_MIDNIGHT] = "current astro data update"
+};
+
+
+static gboolean
+heap_less(const wakeup_queue *queue,
+          const gint i,
+          const gint j)
+{
+    return difftime(queue->deadline[queue->heap[i]],
+                    queue->deadline[queue->heap[j]]) < 0;
+}
+
+
+static void
+heap_swap(wakeup_queue *queue,
+          const gint i,
+          const gint j)
+{
+    wakeup_type type = queue->heap[i];
+
+    queue->heap[i] = queue->heap[j];
+    queue->heap[j] = type;
+    queue->pos[queue->heap[i]] = i;
+    queue->pos[queue->heap[j]] = j;
+}
+
+
+static void
+heap_sift_up(wakeup_queue *queue,
+             gint i)
+{
+    while (i > 0 && heap_less(queue, i, (i - 1) / 2)) {
+        heap_swap(queue, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+
+static void
+heap_sift_down(wakeup_queue *queue,
+               gint i)
+{
+    gint child;
+
+    while ((child = 2 * i + 1) < queue->len) {
+        if (child + 1 < queue->len && heap_less(queue, child + 1, child))
+            child++;
+        if (!heap_less(queue, child, i))
+            break;
+        heap_swap(queue, i, child);
+        i = child;
+    }
+}
+
+
+wakeup_queue *
+make_wakeup_queue(void)
+{
+    wakeup_queue *queue;
+    gint i;
+
+    queue = g_slice_new0(wakeup_queue);
+    for (i = 0; i < WAKEUP_NUM; i++)
+        queue->pos[i] = -1;
+    return queue;
+}
+
+
+/*
+ * Queue the deadline for the given type, replacing any previous one.
+ * A deadline of 0 removes the type from the queue.
+ */
+void
+wakeup_queue_set(wakeup_queue *queue,
+                 const wakeup_type type,
+                 const time_t deadline)
+{
+    gint i;
+
+    g_assert(queue != NULL && type < WAKEUP_NUM);
+    if (G_UNLIKELY(queue == NULL || type >= WAKEUP_NUM))
+        return;
+
+    i = queue->pos[type];
+    if (deadline == 0) {
+        if (i < 0)
+            return;
+        queue->len--;
+        if (i != queue->len) {
+            heap_swap(queue, i, queue->len);
+            heap_sift_up(queue, i);
+            heap_sift_down(queue, i);
+        }
+        queue->pos[type] = -1;
+        queue->deadline[type] = 0;
+        return;
+    }
+
+    queue->deadline[type] = deadline;
+    if (i < 0) {
+        i = queue->len++;
+        queue->heap[i] = type;
+        queue->pos[type] = i;
+    }
+    heap_sift_up(queue, i);
+    heap_sift_down(queue, queue->pos[type]);
+}
+
+
+/*
+ * Get the earliest deadline. Returns FALSE if nothing is queued.
+ */
+gboolean
+wakeup_queue_peek(const wakeup_queue *queue,
+                  wakeup_type *type,
+                  time_t *deadline)
+{
+    if (G_UNLIKELY(queue == NULL) || queue->len == 0)
+        return FALSE;
+
+    if (type)
+        *type = queue->heap[0];
+    if (deadline)
+        *deadline = queue->deadline[queue->heap[0]];
+    return TRUE;
+}
+
+
+const gchar *
+wakeup_type_get_name(const wakeup_type type)
+{
+    if (G_UNLIKELY(type >= WAKEUP_NUM))
+        return NULL;
+    return wakeup_names[type];
+}
+
+
+void
+wakeup_queue_free(wakeup_queue *queue)
+{
+    if (G_UNLIKELY(queue == NULL))
+        return;
+    g_slice_free(wakeup_queue, queue);
+}
+
+
+#ifdef HAVE_SYS_TIMERFD_H
+/*
+ * A realtime timerfd created with TFD_TIMER_CANCEL_ON_SET becomes
+ * readable as soon as the wall clock is set, including the adjustment
+ * after the system resumed, so it can be polled without any timeout.
+ */
+typedef struct {
+    GSource source;
+    GPollFD pollfd;
+} clock_change_source;
+
+
+static gboolean
+clock_change_arm(gint fd)
+{
+    struct itimerspec its;
+
+    /* the timer itself is never meant to expire, re-armed if it does */
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = time(NULL) + 365 * 24 * 3600;
+    return (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                            &its, NULL) == 0);
+}
+
+
+static gboolean
+clock_change_prepare(GSource *source,
+                     gint *timeout)
+{
+    *timeout = -1;
+    return FALSE;
+}
+
+
+static gboolean
+clock_change_check(GSource *source)
+{
+    clock_change_source *ccs = (clock_change_source *) source;
+
+    return (ccs->pollfd.revents & G_IO_IN) != 0;
+}
+
+
+static gboolean
+clock_change_dispatch(GSource *source,
+                      GSourceFunc callback,
+                      gpointer user_data)
+{
+    clock_change_source *ccs = (clock_change_source *) source;
+    guint64 expirations;
+    ssize_t len;
+
+    /* fails with ECANCELED if the clock has been set */
+    len = read(ccs->pollfd.fd, &expirations, sizeof(expirations));
+    if (len < 0 && errno == EAGAIN)
+        return TRUE;
+    if (G_UNLIKELY(!clock_change_arm(ccs->pollfd.fd))) {
+        g_warning("Could not re-arm clock change timer: %s",
+                  g_strerror(errno));
+        return FALSE;
+    }
+    return callback ? callback(user_data) : TRUE;
+}
+
+
+static void
+clock_change_finalize(GSource *source)
+{
+    clock_change_source *ccs = (clock_change_source *) source;
+
+    close(ccs->pollfd.fd);
+}
+
+
+static GSourceFuncs clock_change_funcs = {
+    clock_change_prepare,
+    clock_change_check,
+    clock_change_dispatch,
+    clock_change_finalize,
+    NULL,
+    NULL
+};
+
+
+static GSource *
+make_clock_change_source(void)
+{
+    clock_change_source *ccs;
+    gint fd;
+
+    fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (G_UNLIKELY(fd < 0))
+        return NULL;
+    if (G_UNLIKELY(!clock_change_arm(fd))) {
+        close(fd);
+        return NULL;
+    }
+
+    ccs = (clock_change_source *)
+        g_source_new(&clock_change_funcs, sizeof(clock_change_source));
+    ccs->pollfd.fd = fd;
+    ccs->pollfd.events = G_IO_IN | G_IO_ERR;
+    g_source_add_poll(&ccs->source, &ccs->pollfd);
+    return &ccs->source;
+}
+
+
+static gboolean
+cb_clock_changed(gpointer user_data)
+{
+    wakeup_monitor *monitor = user_data;
+
+    weather_debug("Wall clock has been set.");
+    monitor->func(monitor->user_data);
+    return TRUE;
+}
+#endif
+
+
+static void
+cb_prepare_for_sleep(GDBusConnection *bus,
+                     const gchar *sender_name,
+                     const gchar *object_path,
+                     const gchar *interface_name,
+                     const gchar *signal_name,
+                     GVariant *parameters,
+                     gpointer user_data)
+{
+    wakeup_monitor *monitor = user_data;
+    gboolean sleeping;
+
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(b)")))
+        return;
+    g_variant_get(parameters, "(b)", &sleeping);
+    weather_debug("System is %s.", sleeping ? "going to sleep" : "resuming");
+    if (!sleeping)
+        monitor->func(monitor->user_data);
+}
+
+
+static void
+cb_system_bus(GObject *source,
+              GAsyncResult *result,
+              gpointer user_data)
+{
+    wakeup_monitor *monitor;
+    GDBusConnection *bus;
+    GError *error = NULL;
+
+    bus = g_bus_get_finish(result, &error);
+    if (bus == NULL) {
+        /* the monitor is already gone if the request was cancelled */
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            weather_debug("No system bus for sleep notifications: %s",
+                          error->message);
+        g_error_free(error);
+        return;
+    }
+
+    monitor = user_data;
+    monitor->bus = bus;
+    monitor->sleep_signal =
+        g_dbus_connection_signal_subscribe(bus, LOGIND_NAME,
+                                           LOGIND_MANAGER_IFACE,
+                                           "PrepareForSleep", LOGIND_PATH,
+                                           NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+                                           cb_prepare_for_sleep,
+                                           monitor, NULL);
+}
+
+
+/*
+ * Watch for system events that make queued deadlines unreliable,
+ * namely resuming from suspend and changes of the wall clock, and
+ * call func when they happen.
+ */
+wakeup_monitor *
+make_wakeup_monitor(wakeup_monitor_func func,
+                    gpointer user_data)
+{
+    wakeup_monitor *monitor;
+
+    monitor = g_slice_new0(wakeup_monitor);
+    monitor->func = func;
+    monitor->user_data = user_data;
+
+    monitor->cancellable = g_cancellable_new();
+    g_bus_get(G_BUS_TYPE_SYSTEM, monitor->cancellable,
+              cb_system_bus, monitor);
+
+#ifdef HAVE_SYS_TIMERFD_H
+    monitor->clock_source = make_clock_change_source();
+    if (monitor->clock_source) {
+        g_source_set_callback(monitor->clock_source, cb_clock_changed,
+                              monitor, NULL);
+        g_source_attach(monitor->clock_source, NULL);
+    } else
+        weather_debug("Clock change notifications are not available.");
+#endif
+    return monitor;
+}
+
+
+void
+wakeup_monitor_free(wakeup_monitor *monitor)
+{
+    if (G_UNLIKELY(monitor == NULL))
+        return;
+
+    g_cancellable_cancel(monitor->cancellable);
+    g_object_unref(monitor->cancellable);
+    if (monitor->bus) {
+        g_dbus_connection_signal_unsubscribe(monitor->bus,
+                                             monitor->sleep_signal);
+        g_object_unref(monitor->bus);
+    }
+    if (monitor->clock_source) {
+        g_source_destroy(monitor->clock_source);
+        g_source_unref(monitor->clock_source);
+    }
+    g_slice_free(wakeup_monitor, monitor);
+}
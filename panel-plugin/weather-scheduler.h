@@ -0,0 +1,77 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __WEATHER_SCHEDULER_H__
+#define __WEATHER_SCHEDULER_H__
+
+G_BEGIN_DECLS
+
+/* things the plugin needs to wake up for */
+typedef enum {
+    WAKEUP_ASTRO_DOWNLOAD,
+    WAKEUP_WEATHER_DOWNLOAD,
+    WAKEUP_CONDITIONS_UPDATE,
+    WAKEUP_SUNRISE,
+    WAKEUP_SUNSET,
+    WAKEUP_MIDNIGHT,
+    WAKEUP_NUM
+} wakeup_type;
+
+/* binary min-heap of deadlines, with at most one entry per type */
+typedef struct {
+    time_t deadline[WAKEUP_NUM];
+    wakeup_type heap[WAKEUP_NUM];
+    gint pos[WAKEUP_NUM];       /* index in heap, -1 if not queued */
+    gint len;
+} wakeup_queue;
+
+/* called when the system resumed or the wall clock has been set */
+typedef void (*wakeup_monitor_func) (gpointer user_data);
+
+typedef struct {
+    wakeup_monitor_func func;
+    gpointer user_data;
+    GCancellable *cancellable;
+    GDBusConnection *bus;
+    guint sleep_signal;         /* logind PrepareForSleep subscription */
+    GSource *clock_source;      /* timerfd cancelled on clock changes */
+} wakeup_monitor;
+
+
+wakeup_queue *make_wakeup_queue(void);
+
+void wakeup_queue_set(wakeup_queue *queue,
+                      wakeup_type type,
+                      time_t deadline);
+
+gboolean wakeup_queue_peek(const wakeup_queue *queue,
+                           wakeup_type *type,
+                           time_t *deadline);
+
+const gchar *wakeup_type_get_name(wakeup_type type);
+
+void wakeup_queue_free(wakeup_queue *queue);
+
+wakeup_monitor *make_wakeup_monitor(wakeup_monitor_func func,
+                                    gpointer user_data);
+
+void wakeup_monitor_free(wakeup_monitor *monitor);
+
+G_END_DECLS
+
+#endif
@@ -365,8 +365,8 @@ create_summary_tab(plugin_data *data)
     /* TRANSLATORS: Please use as many \t as appropriate to align the
        date/time values as in the original. */
     APPEND_BTEXT(_("\nDownloads\n"));
-    last_download = format_date(data->weather_update->last, NULL, TRUE);
-    next_download = format_date(data->weather_update->next, NULL, TRUE);
+    last_download = format_date(data->weather_update->last, NULL, data->tz);
+    next_download = format_date(data->weather_update->next, NULL, data->tz);
     value = g_strdup_printf(_("\tWeather data:\n"
                               "\tLast:\t%s\n"
                               "\tNext:\t%s\n"
@@ -388,8 +388,8 @@ create_summary_tab(plugin_data *data)
                "\tPlease file a bug on https://bugzilla.xfce.org if no one\n"
                "\telse has done so yet.\n\n"));
 
-    last_download = format_date(data->astro_update->last, NULL, TRUE);
-    next_download = format_date(data->astro_update->next, NULL, TRUE);
+    last_download = format_date(data->astro_update->last, NULL, data->tz);
+    next_download = format_date(data->astro_update->next, NULL, data->tz);
     value = g_strdup_printf(_("\tAstronomical data:\n"
                               "\tLast:\t%s\n"
                               "\tNext:\t%s\n"
@@ -412,7 +412,7 @@ create_summary_tab(plugin_data *data)
 
     /* calculation times */
     APPEND_BTEXT(_("\nTimes Used for Calculations\n"));
-    point = format_date(conditions->point, NULL, TRUE);
+    point = format_date(conditions->point, NULL, data->tz);
     value = g_strdup_printf
         (_("\tTemperatures, wind, atmosphere and cloud data calculated\n"
            "\tfor:\t\t%s\n"),
@@ -420,8 +420,8 @@ create_summary_tab(plugin_data *data)
     g_free(point);
     APPEND_TEXT_ITEM_REAL(value);
 
-    interval_start = format_date(conditions->start, NULL, TRUE);
-    interval_end = format_date(conditions->end, NULL, TRUE);
+    interval_start = format_date(conditions->start, NULL, data->tz);
+    interval_end = format_date(conditions->end, NULL, data->tz);
     value = g_strdup_printf
         (_("\n\tPrecipitation and the weather symbol have been calculated\n"
            "\tusing the following time interval:\n"
@@ -443,12 +443,13 @@ create_summary_tab(plugin_data *data)
             value = g_strdup(_("\tSunset:\t\tThe sun never sets today.\n"));
             APPEND_TEXT_ITEM_REAL(value);
         } else {
-            sunrise = format_date(data->current_astro->sunrise, NULL, TRUE);
+            sunrise =
+                format_date(data->current_astro->sunrise, NULL, data->tz);
             value = g_strdup_printf(_("\tSunrise:\t\t%s\n"), sunrise);
             g_free(sunrise);
             APPEND_TEXT_ITEM_REAL(value);
 
-            sunset = format_date(data->current_astro->sunset, NULL, TRUE);
+            sunset = format_date(data->current_astro->sunset, NULL, data->tz);
             value = g_strdup_printf(_("\tSunset:\t\t%s\n\n"), sunset);
             g_free(sunset);
             APPEND_TEXT_ITEM_REAL(value);
@@ -471,12 +472,14 @@ create_summary_tab(plugin_data *data)
                 g_strdup(_("\tMoonset:\tThe moon never sets today.\n"));
             APPEND_TEXT_ITEM_REAL(value);
         } else {
-            moonrise = format_date(data->current_astro->moonrise, NULL, TRUE);
+            moonrise =
+                format_date(data->current_astro->moonrise, NULL, data->tz);
             value = g_strdup_printf(_("\tMoonrise:\t%s\n"), moonrise);
             g_free(moonrise);
             APPEND_TEXT_ITEM_REAL(value);
 
-            moonset = format_date(data->current_astro->moonset, NULL, TRUE);
+            moonset =
+                format_date(data->current_astro->moonset, NULL, data->tz);
             value = g_strdup_printf(_("\tMoonset:\t%s\n"), moonset);
             g_free(moonset);
             APPEND_TEXT_ITEM_REAL(value);
@@ -594,15 +597,20 @@ create_summary_tab(plugin_data *data)
 
 
 static gchar *
-get_dayname(gint day)
+get_dayname(gint day,
+            GTimeZone *tz)
 {
-    struct tm fcday_tm;
-    time_t now_t = time(NULL), fcday_t;
-    gint weekday;
-
-    fcday_tm = *localtime(&now_t);
-    fcday_t = time_calc_day(fcday_tm, day);
-    weekday = localtime(&fcday_t)->tm_wday;
+    GDateTime *fcday_dt;
+    time_t fcday_t;
+    gint weekday = 0;
+
+    fcday_t = time_calc_day(time(NULL), day, tz);
+    fcday_dt = make_date_time(fcday_t, tz);
+    if (G_LIKELY(fcday_dt)) {
+        /* GDateTime counts from 1 for Monday, struct tm from 0 for Sunday */
+        weekday = g_date_time_get_day_of_week(fcday_dt) % 7;
+        g_date_time_unref(fcday_dt);
+    }
     switch (day) {
     case 0:
         return g_strdup_printf(_("Today"));
@@ -628,19 +636,19 @@ forecast_cell_get_tooltip_text(plugin_data *data,
        that looks much better and saves space.
     */
     text = g_string_new(_("<b>Times used for calculations</b>\n"));
-    value = format_date(fcdata->start, NULL, TRUE);
+    value = format_date(fcdata->start, NULL, data->tz);
     g_string_append_printf(text, _("<tt><small>"
                                    "Interval start:       %s"
                                    "</small></tt>\n"),
                            value);
     g_free(value);
-    value = format_date(fcdata->end, NULL, TRUE);
+    value = format_date(fcdata->end, NULL, data->tz);
     g_string_append_printf(text, _("<tt><small>"
                                    "Interval end:         %s"
                                    "</small></tt>\n"),
                            value);
     g_free(value);
-    value = format_date(fcdata->point, NULL, TRUE);
+    value = format_date(fcdata->point, NULL, data->tz);
     g_string_append_printf(text, _("<tt><small>"
                                    "Data calculated for:  %s"
                                    "</small></tt>\n\n"),
@@ -701,7 +709,8 @@ forecast_cell_get_tooltip_text(plugin_data *data,
 
 
 static gchar *
-forecast_day_header_tooltip_text(xml_astro *astro)
+forecast_day_header_tooltip_text(xml_astro *astro,
+                                 GTimeZone *tz)
 {
     GString *text;
     gchar *result, *day, *sunrise, *sunset, *moonrise, *moonset;
@@ -714,7 +723,7 @@ forecast_day_header_tooltip_text(xml_astro *astro)
 
     text = g_string_new("");
     if (astro) {
-        day = format_date(astro->day, "%Y-%m-%d", TRUE);
+        day = format_date(astro->day, "%Y-%m-%d", tz);
         g_string_append_printf(text, _("<b>%s</b>\n"), day);
         g_free(day);
 
@@ -727,13 +736,13 @@ forecast_day_header_tooltip_text(xml_astro *astro)
                                     "Sunset: The sun never sets this day."
                                     "</small></tt>\n"));
         else {
-            sunrise = format_date(astro->sunrise, NULL, TRUE);
+            sunrise = format_date(astro->sunrise, NULL, tz);
             g_string_append_printf(text, _("<tt><small>"
                                            "Sunrise: %s"
                                            "</small></tt>\n"), sunrise);
             g_free(sunrise);
 
-            sunset = format_date(astro->sunset, NULL, TRUE);
+            sunset = format_date(astro->sunset, NULL, tz);
             g_string_append_printf(text, _("<tt><small>"
                                            "Sunset:  %s"
                                            "</small></tt>\n\n"), sunset);
@@ -760,13 +769,13 @@ forecast_day_header_tooltip_text(xml_astro *astro)
                               "Moonset: The moon never sets this day."
                               "</small></tt>\n"));
         else {
-            moonrise = format_date(astro->moonrise, NULL, TRUE);
+            moonrise = format_date(astro->moonrise, NULL, tz);
             g_string_append_printf(text, _("<tt><small>"
                                            "Moonrise: %s"
                                            "</small></tt>\n"), moonrise);
             g_free(moonrise);
 
-            moonset = format_date(astro->moonset, NULL, TRUE);
+            moonset = format_date(astro->moonset, NULL, tz);
             g_string_append_printf(text, _("<tt><small>"
                                            "Moonset:  %s"
                                            "</small></tt>"), moonset);
@@ -825,7 +834,7 @@ add_forecast_header(const gchar *text,
 
 static GtkWidget *
 add_forecast_cell(plugin_data *data,
-                  GArray *daydata,
+                  xml_time *fcdata,
                   gint day,
                   gint daytime)
 {
@@ -833,18 +842,11 @@ add_forecast_cell(plugin_data *data,
     GdkPixbuf *icon;
     const GdkColor black = {0, 0x0000, 0x0000, 0x0000};
     gchar *wind_speed, *wind_direction, *value, *rawvalue;
-    xml_time *fcdata;
 
     box = gtk_vbox_new(FALSE, 0);
 
-    fcdata = make_forecast_data(data->weatherdata, daydata, day, daytime);
-    if (fcdata == NULL)
-        return box;
-
-    if (fcdata->location == NULL) {
-        xml_time_free(fcdata);
+    if (fcdata == NULL || fcdata->location == NULL)
         return box;
-    }
 
     /* symbol */
     rawvalue = get_data(fcdata, data->units, SYMBOL,
@@ -902,7 +904,6 @@ add_forecast_cell(plugin_data *data,
     gtk_widget_set_tooltip_markup(GTK_WIDGET(box), value);
     g_free(value);
 
-    xml_time_free(fcdata);
     return box;
 }
 
@@ -914,7 +915,7 @@ make_forecast(plugin_data *data)
     GtkWidget *forecast_box;
     const GdkColor lightbg = {0, 0xeaea, 0xeaea, 0xeaea};
     const GdkColor darkbg = {0, 0x6666, 0x6666, 0x6666};
-    GArray *daydata;
+    forecast_grid *grid;
     xml_astro *astro;
     gchar *dayname, *text;
     gint i;
@@ -940,9 +941,12 @@ make_forecast(plugin_data *data)
     ATTACH_DAYTIME_HEADER(_("Evening"), 3);
     ATTACH_DAYTIME_HEADER(_("Night"), 4);
 
+    /* forecast data is only calculated again when it has changed */
+    grid = get_forecast_grid(data);
+
     for (i = 0; i < data->forecast_days; i++) {
         /* forecast day headers */
-        dayname = get_dayname(i);
+        dayname = get_dayname(i, data->tz);
         if (data->forecast_layout == FC_LAYOUT_CALENDAR)
             ebox = add_forecast_header(dayname, 0.0, &darkbg);
         else
@@ -950,8 +954,11 @@ make_forecast(plugin_data *data)
         g_free(dayname);
 
         /* add tooltip to forecast day header */
-        astro = get_astro_data_for_day(data->astrodata, i);
-        text = forecast_day_header_tooltip_text(astro);
+        if (grid)
+            astro = forecast_grid_get_astro(grid, i);
+        else
+            astro = get_astro_data_for_day(data->astrodata, i, data->tz);
+        text = forecast_day_header_tooltip_text(astro, data->tz);
         gtk_widget_set_tooltip_markup(GTK_WIDGET(ebox), text);
 
         if (data->forecast_layout == FC_LAYOUT_CALENDAR)
@@ -961,12 +968,12 @@ make_forecast(plugin_data *data)
             gtk_table_attach_defaults(GTK_TABLE(table), GTK_WIDGET(ebox),
                                       0, 1, i+1, i+2);
 
-        /* to speed up things, first get forecast data for all daytimes */
-        daydata = get_point_data_for_day(data->weatherdata, i);
-
-        /* get forecast data for each daytime */
+        /* add forecast data for each daytime */
         for (daytime = MORNING; daytime <= NIGHT; daytime++) {
-            forecast_box = add_forecast_cell(data, daydata, i, daytime);
+            forecast_box = add_forecast_cell(data,
+                                             forecast_grid_get(grid, i,
+                                                               daytime),
+                                             i, daytime);
             align = gtk_alignment_new(0.5, 0.5, 1, 1);
             gtk_container_set_border_width(GTK_CONTAINER(align), 4);
             gtk_container_add(GTK_CONTAINER(align), GTK_WIDGET(forecast_box));
@@ -984,7 +991,6 @@ make_forecast(plugin_data *data)
                                           GTK_WIDGET(ebox),
                                           1+daytime, 2+daytime, i+1, i+2);
         }
-        g_array_free(daydata, FALSE);
     }
     return table;
 }
@@ -1111,7 +1117,7 @@ update_summary_subtitle(plugin_data *data)
     else
 #endif
         date_format = "%Y-%m-%d %H:%M:%S %z (%Z)";
-    date = format_date(now_t, date_format, TRUE);
+    date = format_date(now_t, date_format, data->tz);
     title = g_strdup_printf("%s\n%s", data->location_name, date);
     g_free(date);
     xfce_titled_dialog_set_subtitle(XFCE_TITLED_DIALOG(data->summary_window),
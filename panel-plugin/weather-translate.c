@@ -185,19 +185,34 @@ replace_symbol_id(gint id)
 }
 
 
-const gchar *
-get_symbol_for_id(guint id)
+/*
+ * Map a met.no symbol number to one of the symbol ids we support,
+ * returning 0 (no data) if there is no match.
+ */
+guint
+normalize_symbol_id(guint id)
 {
     if (G_UNLIKELY(id < 1))
-        return NODATA;
+        return 0;
 
-    if (id >= NUM_SYMBOLS)
+    if (id > NUM_SYMBOLS)
         id = replace_symbol_id(id);
 
-    if (id < NUM_SYMBOLS)
-        return symbol_to_desc[id-1].symbol;
+    if (id <= NUM_SYMBOLS)
+        return id;
+
+    return 0;
+}
+
+
+const gchar *
+get_symbol_for_id(guint id)
+{
+    id = normalize_symbol_id(id);
+    if (G_UNLIKELY(id < 1))
+        return NODATA;
 
-    return NODATA;
+    return symbol_to_desc[id-1].symbol;
 }
 
 
@@ -24,6 +24,8 @@
 
 G_BEGIN_DECLS
 
+guint normalize_symbol_id(guint id);
+
 const gchar *get_symbol_for_id(guint id);
 
 const gchar *translate_desc(const gchar *desc,
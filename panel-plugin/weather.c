@@ -29,8 +29,10 @@
 #include "weather-parsers.h"
 #include "weather-data.h"
 #include "weather.h"
+#include "weather-astro.h"
 
 #include "weather-translate.h"
+#include "weather-cache.h"
 #include "weather-summary.h"
 #include "weather-config.h"
 #include "weather-icon.h"
@@ -38,11 +40,16 @@
 
 #define XFCEWEATHER_ROOT "weather"
 #define CACHE_FILE_MAX_AGE (48 * 3600)
+#define CACHE_WRITE_DELAY (5)    /* coalesce cache writes, in seconds */
+#define DOWNLOAD_INTERVAL_MIN (30 * 60)
+#define DOWNLOAD_INTERVAL_MAX (6 * 3600)
 #define BORDER (8)
 #define CONN_TIMEOUT (10)        /* connection timeout in seconds */
 #define CONN_MAX_ATTEMPTS (3)    /* max retry attempts using small interval */
 #define CONN_RETRY_INTERVAL_SMALL (10)
 #define CONN_RETRY_INTERVAL_LARGE (10 * 60)
+#define API_URL "https://api.met.no/weatherapi"
+#define API_URL_ENV "XFCE_WEATHER_API_URL"
 
 /* met.no sunrise API returns data for up to 30 days in the future and
    will return an error page if too many days are requested. Let's
@@ -50,11 +57,6 @@
    10 days forecast too. */
 #define ASTRODATA_MAX_DAYS 25
 
-/* standard update interval in seconds used as a precaution to deal
-   with suspend/resume events etc., when nothing needs to be updated
-   earlier: */
-#define DEFAULT_UPDATE_INTERVAL 10
-
 #define DATA_AND_UNIT(var, item)                        \
     value = get_data(conditions, data->units, item,     \
                      data->round, data->night_time);    \
@@ -79,21 +81,78 @@
 #define CACHE_READ_STRING(var, key)                         \
     var = g_key_file_get_string(keyfile, group, key, NULL); \
 
-#define SCHEDULE_WAKEUP_COMPARE(var, reason)        \
-    if (difftime(var, now_t) < diff) {              \
-        data->next_wakeup = var;                    \
-        diff = difftime(data->next_wakeup, now_t);  \
-        data->next_wakeup_reason = reason;          \
-    }
+#define UPDATE_INFO_SET_VALIDATORS(upi, headers)                    \
+    update_info_set_validators                                      \
+    (upi,                                                           \
+     soup_message_headers_get_one(headers, "ETag"),                 \
+     soup_message_headers_get_one(headers, "Last-Modified"),        \
+     soup_message_headers_get_one(headers, "Expires"))
 
 
 gboolean debug_mode = FALSE;
 
+/* cache file keys for the location values */
+static const gchar *cache_location_keys[LOC_VALUES_NUM] = {
+    [LOC_ALTITUDE] = "altitude",
+    [LOC_LATITUDE] = "latitude",
+    [LOC_LONGITUDE] = "longitude",
+    [LOC_TEMPERATURE] = "temperature_value",
+    [LOC_WIND_DIR_DEG] = "wind_dir_deg",
+    [LOC_WIND_SPEED_MPS] = "wind_speed_mps",
+    [LOC_WIND_SPEED_BEAUFORT] = "wind_speed_beaufort",
+    [LOC_HUMIDITY] = "humidity_value",
+    [LOC_PRESSURE] = "pressure_value",
+    [LOC_CLOUDS + CLOUDS_PERC_LOW] = "clouds_percent_0",
+    [LOC_CLOUDS + CLOUDS_PERC_MID] = "clouds_percent_1",
+    [LOC_CLOUDS + CLOUDS_PERC_HIGH] = "clouds_percent_2",
+    [LOC_CLOUDS + CLOUDS_PERC_CLOUDINESS] = "clouds_percent_3",
+    [LOC_FOG] = "fog_percent",
+    [LOC_PRECIPITATION] = "precipitation_value"
+};
+
+
+/*
+ * State of a single weather download. Each request gets its own
+ * parser, which is used by the worker thread only and freed when the
+ * worker finishes the download.
+ */
+typedef struct {
+    plugin_data *data;
+    xml_weather *wd;            /* data parsed so far */
+    weather_parser *parser;
+    guint generation;           /* of the weather data when requested */
+} weather_download;
+
+/* work item of the weather worker thread */
+typedef struct {
+    plugin_data *data;
+    weather_download *download; /* download the chunk belongs to */
+    gchar *chunk;               /* downloaded data to parse */
+    gsize len;
+    gchar *cache_file;          /* file to write cache_contents to */
+    gchar *cache_contents;
+    gsize cache_len;
+    xml_weather *wd;            /* private copy of the weather data */
+    gchar *etag;                /* validators of the response */
+    gchar *last_modified;
+    gchar *expires;
+    time_t next_run;
+    guint generation;
+    gboolean downloaded;
+    gboolean parsing_error;
+    time_t now_t;
+    time_t conditions_t;
+    time_t conditions_next;
+    GTimeZone *tz;              /* for calculating current conditions */
+} weather_job;
+
 
-static void write_cache_file(plugin_data *data);
+static void schedule_cache_write(plugin_data *data);
 
 static void schedule_next_wakeup(plugin_data *data);
 
+static gboolean cb_weather_processed(gpointer user_data);
+
 
 void
 weather_http_queue_request(SoupSession *session,
@@ -196,15 +255,87 @@ make_update_info(const guint check_interval)
 }
 
 
+static void
+update_info_free(update_info *upi)
+{
+    if (G_UNLIKELY(upi == NULL))
+        return;
+    g_free(upi->etag);
+    g_free(upi->last_modified);
+    g_slice_free(update_info, upi);
+}
+
+
+/*
+ * Remember the validators of a response. Values missing in the
+ * response are kept, as a 304 response need not repeat them.
+ */
+static void
+update_info_set_validators(update_info *upi,
+                           const gchar *etag,
+                           const gchar *last_modified,
+                           const gchar *expires)
+{
+    SoupDate *date;
+
+    if (etag) {
+        g_free(upi->etag);
+        upi->etag = g_strdup(etag);
+    }
+    if (last_modified) {
+        g_free(upi->last_modified);
+        upi->last_modified = g_strdup(last_modified);
+    }
+    if (expires && (date = soup_date_new_from_string(expires))) {
+        upi->expires = soup_date_to_time_t(date);
+        soup_date_free(date);
+    }
+}
+
+
+/*
+ * Base URL of the met.no API. It can be overridden in the environment
+ * to test downloads against a local server.
+ */
+static const gchar *
+get_api_url(void)
+{
+    const gchar *url = g_getenv(API_URL_ENV);
+
+    return (url && strlen(url) > 0) ? url : API_URL;
+}
+
+
+/*
+ * Make a request that the server may answer with 304 Not Modified if
+ * the data has not changed since the last successful download.
+ */
+static SoupMessage *
+make_conditional_request(const gchar *url,
+                         const update_info *upi)
+{
+    SoupMessage *msg;
+
+    msg = soup_message_new("GET", url);
+    if (upi->etag)
+        soup_message_headers_append(msg->request_headers,
+                                    "If-None-Match", upi->etag);
+    if (upi->last_modified)
+        soup_message_headers_append(msg->request_headers,
+                                    "If-Modified-Since", upi->last_modified);
+    return msg;
+}
+
+
 static void
 init_update_infos(plugin_data *data)
 {
     if (G_LIKELY(data->astro_update))
-        g_slice_free(update_info, data->astro_update);
+        update_info_free(data->astro_update);
     if (G_LIKELY(data->weather_update))
-        g_slice_free(update_info, data->weather_update);
+        update_info_free(data->weather_update);
     if (G_LIKELY(data->conditions_update))
-        g_slice_free(update_info, data->conditions_update);
+        update_info_free(data->conditions_update);
 
     data->astro_update = make_update_info(24 * 3600);
     data->weather_update = make_update_info(60 * 60);
@@ -240,20 +371,98 @@ get_tooltip_icon_size(plugin_data *data)
 }
 
 
+/*
+ * Make a timezone from its identifier, returning NULL if it is empty
+ * or unknown. GLib versions before 2.68 cannot tell and use UTC for
+ * unknown identifiers.
+ */
+static GTimeZone *
+make_time_zone(const gchar *identifier)
+{
+    GTimeZone *tz;
+
+    if (identifier == NULL || strlen(identifier) == 0)
+        return NULL;
+#if GLIB_CHECK_VERSION(2, 68, 0)
+    tz = g_time_zone_new_identifier(identifier);
+#else
+    tz = g_time_zone_new(identifier);
+#endif
+    if (tz == NULL)
+        weather_debug("Unknown timezone %s, ignoring it.", identifier);
+    return tz;
+}
+
+
+/*
+ * Make the timezone used for all local time calculations. The
+ * environment of the panel process is left untouched, as it is
+ * shared with other plugins and not safe to change with threads.
+ */
 void
 update_timezone(plugin_data *data)
 {
-    if (data->timezone && strlen(data->timezone) > 0)
-        g_setenv("TZ", data->timezone, TRUE);
-    else {
-        if (data->timezone_initial && strlen(data->timezone_initial) > 0)
-            g_setenv("TZ", data->timezone_initial, TRUE);
-        else
-            g_unsetenv("TZ");
+    if (data->tz)
+        g_time_zone_unref(data->tz);
+
+    data->tz = make_time_zone(data->timezone);
+    if (data->tz == NULL)
+        data->tz = make_time_zone(data->timezone_initial);
+    if (data->tz == NULL)
+        data->tz = g_time_zone_new_local();
+
+    /* days and daytimes depend on the timezone */
+    invalidate_forecast_grid(data);
+    invalidate_tooltip(data);
+}
+
+
+/*
+ * Drop the forecast data when the weather or astronomical data it
+ * has been calculated from changed.
+ */
+void
+invalidate_forecast_grid(plugin_data *data)
+{
+    if (data->forecast) {
+        forecast_grid_free(data->forecast);
+        data->forecast = NULL;
     }
 }
 
 
+/*
+ * Return the forecast data for all days, calculating it only if the
+ * data changed since the last call or a new day has begun.
+ */
+forecast_grid *
+get_forecast_grid(plugin_data *data)
+{
+    if (data->forecast &&
+        difftime(data->forecast->day_t,
+                 day_at_midnight(time(NULL), 0, data->tz)))
+        invalidate_forecast_grid(data);
+
+    if (data->forecast == NULL && data->weatherdata)
+        data->forecast = make_forecast_grid(data->weatherdata,
+                                            data->astrodata,
+                                            MAX_FORECAST_DAYS,
+                                            data->tz);
+    return data->forecast;
+}
+
+
+/*
+ * Mark the cached tooltip markup as outdated, so that it gets rendered
+ * again the next time the tooltip is shown.
+ */
+void
+invalidate_tooltip(plugin_data *data)
+{
+    data->tooltip_generation++;
+}
+
+
 void
 update_icon(plugin_data *data)
 {
@@ -312,6 +521,42 @@ update_valuebox(plugin_data *data,
 }
 
 
+/*
+ * Calculate astronomical data for the days that have not been
+ * downloaded, so that it is available without network access too.
+ */
+static void
+calc_missing_astrodata(plugin_data *data)
+{
+    xml_astro *astro;
+    time_t now_t = time(NULL);
+    gdouble lat, lon;
+    gint i, added = 0;
+
+    if (G_UNLIKELY(data->lat == NULL || data->lon == NULL))
+        return;
+
+    lat = string_to_double(data->lat, 0);
+    lon = string_to_double(data->lon, 0);
+    for (i = 0; i < ASTRODATA_MAX_DAYS; i++) {
+        if (get_astro_data_for_day(data->astrodata, i, data->tz))
+            continue;
+        astro = calc_astro(lat, lon,
+                           day_at_midnight(now_t, i, data->tz),
+                           day_at_midnight(now_t, i + 1, data->tz));
+        if (G_LIKELY(astro)) {
+            g_array_append_val(data->astrodata, astro);
+            added++;
+        }
+    }
+    if (added) {
+        weather_debug("Calculated astrodata for %d days.", added);
+        g_array_sort(data->astrodata, (GCompareFunc) xml_astro_compare);
+        invalidate_forecast_grid(data);
+    }
+}
+
+
 /* get astrodata for the current day */
 static void
 update_current_astrodata(plugin_data *data)
@@ -328,22 +573,70 @@ update_current_astrodata(plugin_data *data)
         tdiff = difftime(now_t, data->current_astro->day);
 
     if (data->current_astro == NULL || tdiff >= 24 * 3600 || tdiff < 0) {
-        data->current_astro = get_astro_data_for_day(data->astrodata, 0);
+        data->current_astro = get_astro_data_for_day(data->astrodata, 0,
+                                                     data->tz);
+        if (data->current_astro == NULL) {
+            calc_missing_astrodata(data);
+            data->current_astro = get_astro_data_for_day(data->astrodata, 0,
+                                                         data->tz);
+        }
         if (G_UNLIKELY(data->current_astro == NULL))
             weather_debug("No current astrodata available.");
         else
             weather_debug("Updated current astrodata.");
+        invalidate_tooltip(data);
     }
 }
 
 
+/*
+ * Current conditions are calculated for exact 5 minute intervals.
+ * Return the start of the interval containing now_t and store the
+ * start of the following one in next_t. UTC offsets are multiples
+ * of 5 minutes, so this does not depend on the timezone.
+ */
+static time_t
+calc_conditions_time(time_t now_t,
+                     time_t *next_t)
+{
+    time_t result;
+
+    result = now_t - now_t % (5 * 60);
+    *next_t = result + 5 * 60;
+    return result;
+}
+
+
+/*
+ * Update astrodata and widgets for the already calculated current
+ * conditions and schedule the next update.
+ */
+static void
+show_current_conditions(plugin_data *data,
+                        gboolean immediately)
+{
+    /* update current astrodata */
+    update_current_astrodata(data);
+    data->night_time = is_night_time(data->current_astro, data->tz);
+
+    /* update widgets */
+    invalidate_tooltip(data);
+    update_icon(data);
+    update_valuebox(data, immediately);
+
+    /* schedule next update */
+    schedule_next_wakeup(data);
+
+    weather_debug("Updated current conditions.");
+}
+
+
 static void
 update_current_conditions(plugin_data *data,
                           gboolean immediately)
 {
-    struct tm now_tm;
-
     if (G_UNLIKELY(data->weatherdata == NULL)) {
+        invalidate_tooltip(data);
         update_icon(data);
         update_valuebox(data, TRUE);
         schedule_next_wakeup(data);
@@ -351,47 +644,27 @@ update_current_conditions(plugin_data *data,
     }
 
     if (data->weatherdata->current_conditions) {
-        xml_time_free(data->weatherdata->current_conditions);
+        xml_time_unref(data->weatherdata->current_conditions);
         data->weatherdata->current_conditions = NULL;
     }
-    /* use exact 5 minute intervals for calculation */
-    time(&data->conditions_update->last);
-    now_tm = *localtime(&data->conditions_update->last);
-    now_tm.tm_min -= (now_tm.tm_min % 5);
-    if (now_tm.tm_min < 0)
-        now_tm.tm_min = 0;
-    now_tm.tm_sec = 0;
-    data->conditions_update->last = mktime(&now_tm);
-
+    data->conditions_update->last =
+        calc_conditions_time(time(NULL), &data->conditions_update->next);
     data->weatherdata->current_conditions =
         make_current_conditions(data->weatherdata,
-                                data->conditions_update->last);
+                                data->conditions_update->last,
+                                data->tz);
 
-    /* update current astrodata */
-    update_current_astrodata(data);
-    data->night_time = is_night_time(data->current_astro);
-
-    /* update widgets */
-    update_icon(data);
-    update_valuebox(data, immediately);
-
-    /* schedule next update */
-    now_tm.tm_min += 5;
-    data->conditions_update->next = mktime(&now_tm);
-    schedule_next_wakeup(data);
-
-    weather_debug("Updated current conditions.");
+    /* forecast cells may fall back to the current conditions */
+    invalidate_forecast_grid(data);
+    show_current_conditions(data, immediately);
 }
 
 
 static time_t
 calc_next_download_time(const update_info *upi,
                         time_t retry_t) {
-    struct tm retry_tm;
     guint interval;
 
-    retry_tm = *localtime(&retry_t);
-
     /* If the download failed, retry immediately using a small retry
      * interval for a limited number of times. If it still fails after
      * that, continue using a larger interval or the default check,
@@ -408,7 +681,41 @@ calc_next_download_time(const update_info *upi,
             interval = upi->check_interval;
     }
 
-    return time_calc(retry_tm, 0, 0, 0, 0, 0, interval);
+    return retry_t + interval;
+}
+
+
+/*
+ * Schedule the next weather download for when new data is expected,
+ * which is when the next model run has finished or, if that is not
+ * known, when the last response expires. This avoids repeatedly
+ * downloading unchanged data. The result is kept within the limits
+ * configured by the user.
+ */
+static time_t
+calc_next_weather_download_time(const plugin_data *data,
+                                time_t retry_t)
+{
+    const update_info *upi = data->weather_update;
+    time_t expected_t = 0;
+    gdouble interval;
+
+    /* retry failed downloads as usual */
+    if (upi->attempt > 0)
+        return calc_next_download_time(upi, retry_t);
+
+    if (difftime(upi->next_run, retry_t) > 0)
+        expected_t = upi->next_run;
+    else if (difftime(upi->expires, retry_t) > 0)
+        expected_t = upi->expires;
+
+    if (expected_t)
+        interval = difftime(expected_t, retry_t);
+    else
+        interval = upi->check_interval;
+    interval = CLAMP(interval, data->download_interval_min,
+                     data->download_interval_max);
+    return retry_t + (time_t) interval;
 }
 
 
@@ -426,18 +733,40 @@ cb_astro_update(SoupSession *session,
     time_t now_t;
     gboolean parsing_error = TRUE;
 
+    if (data->astro_msg == msg)
+        data->astro_msg = NULL;
+    if (msg->status_code == SOUP_STATUS_CANCELLED) {
+        weather_debug("Astronomical data download has been cancelled.");
+        return;
+    }
+
+    /* current astrodata may get replaced or removed, drop expired
+       data first so that new data is merged into less */
+    data->current_astro = NULL;
+    astrodata_clean(data->astrodata);
+
     time(&now_t);
     data->astro_update->attempt++;
     data->astro_update->http_status_code = msg->status_code;
-    if ((msg->status_code == 200 || msg->status_code == 203)) {
+    if (msg->status_code == 304) {
+        /* not modified, the data we have is still current */
+        weather_debug("Astronomical data has not been modified.");
+        UPDATE_INFO_SET_VALIDATORS(data->astro_update, msg->response_headers);
+        data->astro_update->attempt = 0;
+        data->astro_update->last = now_t;
+        parsing_error = FALSE;
+    } else if ((msg->status_code == 200 || msg->status_code == 203)) {
         doc = get_xml_document(msg);
         if (G_LIKELY(doc)) {
             root_node = xmlDocGetRootElement(doc);
             if (G_LIKELY(root_node))
-                if (parse_astrodata(root_node, data->astrodata)) {
+                if (parse_astrodata(root_node, data->astrodata,
+                                    data->tz)) {
                     /* schedule next update */
                     data->astro_update->attempt = 0;
                     data->astro_update->last = now_t;
+                    UPDATE_INFO_SET_VALIDATORS(data->astro_update,
+                                               msg->response_headers);
                     parsing_error = FALSE;
                 }
             xmlFreeDoc(doc);
@@ -451,77 +780,309 @@ cb_astro_update(SoupSession *session,
     data->astro_update->next = calc_next_download_time(data->astro_update,
                                                        now_t);
 
-    astrodata_clean(data->astrodata);
+    calc_missing_astrodata(data);
     g_array_sort(data->astrodata, (GCompareFunc) xml_astro_compare);
+    invalidate_forecast_grid(data);
     update_current_astrodata(data);
     if (! parsing_error)
         weather_dump(weather_dump_astrodata, data->astrodata);
 
-    /* update icon */
-    data->night_time = is_night_time(data->current_astro);
+    /* update icon and sunrise/sunset times in the tooltip */
+    data->night_time = is_night_time(data->current_astro, data->tz);
+    invalidate_tooltip(data);
     update_icon(data);
 
     data->astro_update->finished = TRUE;
 }
 
 
+static void
+weather_job_free(weather_job *job)
+{
+    g_free(job->etag);
+    g_free(job->last_modified);
+    g_free(job->expires);
+    if (job->tz)
+        g_time_zone_unref(job->tz);
+    g_slice_free(weather_job, job);
+}
+
+
 /*
- * Process downloaded weather data and schedule next weather update.
+ * Finish the parser of a weather download and free the download,
+ * returning the parsed data on success or NULL otherwise. Called by
+ * the worker thread only.
+ */
+static xml_weather *
+finish_weather_download(weather_download *download)
+{
+    xml_weather *wd = download->wd;
+    gboolean result = FALSE;
+
+    if (download->parser)
+        result = weather_parser_finish(download->parser);
+    if (wd && !result) {
+        xml_weather_free(wd);
+        wd = NULL;
+    }
+    g_slice_free(weather_download, download);
+    return wd;
+}
+
+
+/*
+ * Parse downloaded data or merge it into the private copy of the
+ * weather data, clean and sort it and calculate current conditions.
+ * Jobs are processed in order by a single worker thread, which hands
+ * the finished weather data back to the main loop.
+ */
+static void
+weather_worker(gpointer job_data,
+               gpointer user_data)
+{
+    weather_job *job = job_data;
+    plugin_data *data = job->data;
+    weather_download *download;
+    xml_weather *parsed;
+
+    if (job->cache_file) {
+        if (!g_file_set_contents(job->cache_file, job->cache_contents,
+                                 job->cache_len, NULL))
+            g_warning(_("Error writing cache file %s!"), job->cache_file);
+        else
+            weather_debug("Cache file %s has been written.", job->cache_file);
+        g_free(job->cache_file);
+        g_free(job->cache_contents);
+        weather_job_free(job);
+        return;
+    }
+
+    if (job->chunk) {
+        download = job->download;
+        if (download->parser == NULL) {
+            download->wd = make_weather_data();
+            if (G_LIKELY(download->wd))
+                download->parser = make_weather_parser(download->wd);
+        }
+        if (G_LIKELY(download->parser))
+            weather_parser_feed(download->parser, job->chunk, job->len);
+        g_free(job->chunk);
+        weather_job_free(job);
+        return;
+    }
+
+    parsed = finish_weather_download(job->download);
+
+    /* only the download needed to be finished */
+    if (job->wd == NULL) {
+        if (parsed)
+            xml_weather_free(parsed);
+        weather_job_free(job);
+        return;
+    }
+
+    /* drop expired data first, so new data is merged into less */
+    xml_weather_clean(job->wd);
+
+    if (parsed && job->downloaded) {
+        job->next_run = parsed->next_run;
+        merge_weather(job->wd, parsed);
+        job->parsing_error = FALSE;
+    }
+    if (parsed)
+        xml_weather_free(parsed);
+
+    job->wd->current_conditions =
+        make_current_conditions(job->wd, job->conditions_t, job->tz);
+
+    g_async_queue_push(data->weather_results, job);
+    g_idle_add(cb_weather_processed, data);
+}
+
+
+static void
+weather_worker_push(plugin_data *data,
+                    weather_job *job)
+{
+    if (G_LIKELY(data->weather_pool))
+        g_thread_pool_push(data->weather_pool, job, NULL);
+    else
+        weather_worker(job, NULL);
+}
+
+
+/*
+ * Take over weather data processed by the worker thread and update
+ * the widgets. Only a pointer swap is needed to replace the data.
+ */
+static gboolean
+cb_weather_processed(gpointer user_data)
+{
+    plugin_data *data = user_data;
+    weather_job *job;
+
+    job = g_async_queue_try_pop(data->weather_results);
+    if (G_UNLIKELY(job == NULL))
+        return FALSE;
+
+    /* data has been reset while the job was running, so discard it */
+    if (job->generation != data->weather_generation) {
+        weather_debug("Discarding outdated weather data.");
+        xml_weather_free(job->wd);
+        weather_job_free(job);
+        return FALSE;
+    }
+
+    if (!job->parsing_error) {
+        data->weather_update->attempt = 0;
+        data->weather_update->last = job->now_t;
+        update_info_set_validators(data->weather_update, job->etag,
+                                   job->last_modified, job->expires);
+        data->weather_update->next_run = job->next_run;
+    } else if (job->downloaded)
+        g_warning(_("Error parsing weather data!"));
+    data->weather_update->next =
+        calc_next_weather_download_time(data, job->now_t);
+
+    if (data->weatherdata)
+        xml_weather_free(data->weatherdata);
+    data->weatherdata = job->wd;
+    invalidate_forecast_grid(data);
+
+    data->conditions_update->last = job->conditions_t;
+    data->conditions_update->next = job->conditions_next;
+    weather_debug("Updating current conditions.");
+    show_current_conditions(data, !job->parsing_error);
+
+    data->weather_update->finished = TRUE;
+    weather_dump(weather_dump_weatherdata, data->weatherdata);
+    weather_job_free(job);
+    return FALSE;
+}
+
+
+/*
+ * Pass weather data to the worker thread as it arrives, so that the
+ * response body does not need to be accumulated and parsing overlaps
+ * the transfer.
+ */
+static void
+cb_weather_got_chunk(SoupMessage *msg,
+                     SoupBuffer *chunk,
+                     gpointer user_data)
+{
+    weather_download *download = user_data;
+    plugin_data *data = download->data;
+    weather_job *job;
+
+    /* ignore bodies of redirects and error pages */
+    if (msg->status_code != 200 && msg->status_code != 203)
+        return;
+
+    job = g_slice_new0(weather_job);
+    job->data = data;
+    job->download = download;
+    job->chunk = g_malloc(chunk->length);
+    memcpy(job->chunk, chunk->data, chunk->length);
+    job->len = chunk->length;
+    weather_worker_push(data, job);
+}
+
+
+/*
+ * Hand the downloaded weather data over to the worker thread, which
+ * merges it into a private copy of the existing data.
  */
 static void
 cb_weather_update(SoupSession *session,
                   SoupMessage *msg,
                   gpointer user_data)
 {
-    plugin_data *data = user_data;
-    xmlDoc *doc;
-    xmlNode *root_node;
-    time_t now_t;
-    gboolean parsing_error = TRUE;
+    weather_download *download = user_data;
+    plugin_data *data = download->data;
+    weather_job *job;
+
+    if (data->weather_msg == msg)
+        data->weather_msg = NULL;
+
+    /* cancelled or requested before the data has been reset, only the
+       worker needs to free the download */
+    if (msg->status_code == SOUP_STATUS_CANCELLED ||
+        download->generation != data->weather_generation) {
+        weather_debug("Discarding outdated weather download.");
+        job = g_slice_new0(weather_job);
+        job->data = data;
+        job->download = download;
+        weather_worker_push(data, job);
+        return;
+    }
 
     weather_debug("Processing downloaded weather data.");
-    time(&now_t);
     data->weather_update->attempt++;
     data->weather_update->http_status_code = msg->status_code;
-    if (msg->status_code == 200 || msg->status_code == 203) {
-        doc = get_xml_document(msg);
-        if (G_LIKELY(doc)) {
-            root_node = xmlDocGetRootElement(doc);
-            if (G_LIKELY(root_node))
-                if (parse_weather(root_node, data->weatherdata)) {
-                    data->weather_update->attempt = 0;
-                    data->weather_update->last = now_t;
-                    parsing_error = FALSE;
-                }
-            xmlFreeDoc(doc);
-        }
-        if (parsing_error)
-            g_warning(_("Error parsing weather data!"));
-    } else
+
+    /* not modified, so there is nothing to parse or merge */
+    if (msg->status_code == 304) {
+        weather_debug("Weather data has not been modified.");
+        UPDATE_INFO_SET_VALIDATORS(data->weather_update,
+                                   msg->response_headers);
+        data->weather_update->attempt = 0;
+        time(&data->weather_update->last);
+        data->weather_update->next =
+            calc_next_weather_download_time(data,
+                                            data->weather_update->last);
+        data->weather_update->finished = TRUE;
+        schedule_next_wakeup(data);
+
+        /* the worker still owns the download and frees it */
+        job = g_slice_new0(weather_job);
+        job->data = data;
+        job->download = download;
+        weather_worker_push(data, job);
+        return;
+    }
+
+    job = g_slice_new0(weather_job);
+    job->data = data;
+    job->download = download;
+    job->generation = download->generation;
+    job->downloaded = (msg->status_code == 200 || msg->status_code == 203);
+    job->parsing_error = TRUE;
+    time(&job->now_t);
+    job->conditions_t = calc_conditions_time(job->now_t,
+                                             &job->conditions_next);
+    job->tz = g_time_zone_ref(data->tz);
+    job->wd = xml_weather_copy(data->weatherdata);
+    if (G_UNLIKELY(job->wd == NULL))
+        job->wd = make_weather_data();
+    if (job->downloaded) {
+        job->etag = g_strdup(soup_message_headers_get_one
+                             (msg->response_headers, "ETag"));
+        job->last_modified = g_strdup(soup_message_headers_get_one
+                                      (msg->response_headers,
+                                       "Last-Modified"));
+        job->expires = g_strdup(soup_message_headers_get_one
+                                (msg->response_headers, "Expires"));
+    }
+
+    if (!job->downloaded)
         g_warning
             (_("Download of weather data failed with HTTP Status Code %d, "
                "Reason phrase: %s"), msg->status_code, msg->reason_phrase);
-    data->weather_update->next = calc_next_download_time(data->weather_update,
-                                                         now_t);
-
-    xml_weather_clean(data->weatherdata);
-    g_array_sort(data->weatherdata->timeslices,
-                 (GCompareFunc) xml_time_compare);
-    weather_debug("Updating current conditions.");
-    update_current_conditions(data, !parsing_error);
 
-    data->weather_update->finished = TRUE;
-    weather_dump(weather_dump_weatherdata, data->weatherdata);
+    weather_worker_push(data, job);
 }
 
 
 static gboolean
 update_handler(plugin_data *data)
 {
+    SoupMessage *msg;
+    weather_download *download;
     gchar *url;
+    GDateTime *now_dt, *end_dt;
     gboolean night_time;
     time_t now_t, end_t;
-    struct tm now_tm, end_tm;
 
     g_assert(data != NULL);
     if (G_UNLIKELY(data == NULL))
@@ -536,7 +1097,6 @@ update_handler(plugin_data *data)
     }
 
     now_t = time(NULL);
-    now_tm = *localtime(&now_t);
 
     /* check if all started downloads are finished and the cache file
        can be written */
@@ -546,36 +1106,41 @@ update_handler(plugin_data *data)
         data->astro_update->finished = FALSE;
         data->weather_update->started = FALSE;
         data->weather_update->finished = FALSE;
-        write_cache_file(data);
+        schedule_cache_write(data);
     }
 
     /* fetch astronomical data */
     if (difftime(data->astro_update->next, now_t) <= 0) {
         /* real next update time will be calculated when update is finished,
            this is to prevent spawning multiple updates in a row */
-        data->astro_update->next = time_calc_hour(now_tm, 1);
+        data->astro_update->next = time_calc_hour(now_t, 1, data->tz);
         data->astro_update->started = TRUE;
 
         /* calculate date range for request */
-        end_t = time_calc_day(now_tm, ASTRODATA_MAX_DAYS);
-        end_tm = *localtime(&end_t);
+        end_t = time_calc_day(now_t, ASTRODATA_MAX_DAYS, data->tz);
+        now_dt = make_date_time(now_t, data->tz);
+        end_dt = make_date_time(end_t, data->tz);
 
         /* build url */
-        url = g_strdup_printf("https://api.met.no/weatherapi/sunrise/1.1/?"
+        url = g_strdup_printf("%s/sunrise/1.1/?"
                               "lat=%s;lon=%s;"
                               "from=%04d-%02d-%02d;"
                               "to=%04d-%02d-%02d",
-                              data->lat, data->lon,
-                              now_tm.tm_year + 1900,
-                              now_tm.tm_mon + 1,
-                              now_tm.tm_mday,
-                              end_tm.tm_year + 1900,
-                              end_tm.tm_mon + 1,
-                              end_tm.tm_mday);
+                              get_api_url(), data->lat, data->lon,
+                              g_date_time_get_year(now_dt),
+                              g_date_time_get_month(now_dt),
+                              g_date_time_get_day_of_month(now_dt),
+                              g_date_time_get_year(end_dt),
+                              g_date_time_get_month(end_dt),
+                              g_date_time_get_day_of_month(end_dt));
+        g_date_time_unref(now_dt);
+        g_date_time_unref(end_dt);
 
         /* start receive thread */
         g_message(_("getting %s"), url);
-        weather_http_queue_request(data->session, url, cb_astro_update, data);
+        msg = make_conditional_request(url, data->astro_update);
+        data->astro_msg = msg;
+        soup_session_queue_message(data->session, msg, cb_astro_update, data);
         g_free(url);
     }
 
@@ -583,19 +1148,26 @@ update_handler(plugin_data *data)
     if (difftime(data->weather_update->next, now_t) <= 0) {
         /* real next update time will be calculated when update is finished,
            this is to prevent spawning multiple updates in a row */
-        data->weather_update->next = time_calc_hour(now_tm, 1);
+        data->weather_update->next = time_calc_hour(now_t, 1, data->tz);
         data->weather_update->started = TRUE;
 
         /* build url */
         url =
-            g_strdup_printf("https://api.met.no/weatherapi"
-                            "/locationforecastlts/1.3/?lat=%s;lon=%s;msl=%d",
-                            data->lat, data->lon, data->msl);
+            g_strdup_printf("%s/locationforecastlts/1.3/?lat=%s;lon=%s;msl=%d",
+                            get_api_url(), data->lat, data->lon, data->msl);
 
-        /* start receive thread */
+        /* start receive thread, parsing the data while it arrives */
         g_message(_("getting %s"), url);
-        weather_http_queue_request(data->session, url,
-                                   cb_weather_update, data);
+        msg = make_conditional_request(url, data->weather_update);
+        download = g_slice_new0(weather_download);
+        download->data = data;
+        download->generation = data->weather_generation;
+        data->weather_msg = msg;
+        soup_message_body_set_accumulate(msg->response_body, FALSE);
+        g_signal_connect(msg, "got-chunk",
+                         G_CALLBACK(cb_weather_got_chunk), download);
+        soup_session_queue_message(data->session, msg,
+                                   cb_weather_update, download);
         g_free(url);
 
         /* cb_weather_update will deal with everything that follows this
@@ -607,7 +1179,7 @@ update_handler(plugin_data *data)
     if (difftime(data->conditions_update->next, now_t) <= 0) {
         /* real next update time will be calculated when update is finished,
            this is to prevent spawning multiple updates in a row */
-        data->conditions_update->next = time_calc_hour(now_tm, 1);
+        data->conditions_update->next = time_calc_hour(now_t, 1, data->tz);
         weather_debug("Updating current conditions.");
         update_current_conditions(data, FALSE);
         /* update_current_conditions updates day/night time status
@@ -617,10 +1189,11 @@ update_handler(plugin_data *data)
 
     /* update night time status and icon */
     update_current_astrodata(data);
-    night_time = is_night_time(data->current_astro);
+    night_time = is_night_time(data->current_astro, data->tz);
     if (data->night_time != night_time) {
         weather_debug("Night time status changed, updating icon.");
         data->night_time = night_time;
+        invalidate_tooltip(data);
         update_icon(data);
     }
 
@@ -629,10 +1202,16 @@ update_handler(plugin_data *data)
 }
 
 
+/*
+ * Queue the deadlines of everything that needs to be done and set the
+ * timer for the earliest one, so that the plugin only wakes up when
+ * there is something to do.
+ */
 static void
 schedule_next_wakeup(plugin_data *data)
 {
-    time_t now_t = time(NULL), next_day_t;
+    time_t now_t = time(NULL), sunrise_t = 0, sunset_t = 0;
+    wakeup_type type;
     gdouble diff;
     gchar *date;
     GSource *source;
@@ -645,53 +1224,45 @@ schedule_next_wakeup(plugin_data *data)
         }
     }
 
-    next_day_t = day_at_midnight(now_t, 1);
-    diff = difftime(next_day_t, now_t);
-	data->next_wakeup_reason = "current astro data update";
-    SCHEDULE_WAKEUP_COMPARE(data->astro_update->next,
-                            "astro data download");
-    SCHEDULE_WAKEUP_COMPARE(data->weather_update->next,
-                            "weather data download");
-    SCHEDULE_WAKEUP_COMPARE(data->conditions_update->next,
-                            "current conditions update");
+    wakeup_queue_set(data->wakeups, WAKEUP_MIDNIGHT,
+                     day_at_midnight(now_t, 1, data->tz));
+    wakeup_queue_set(data->wakeups, WAKEUP_ASTRO_DOWNLOAD,
+                     data->astro_update->next);
+    wakeup_queue_set(data->wakeups, WAKEUP_WEATHER_DOWNLOAD,
+                     data->weather_update->next);
+    wakeup_queue_set(data->wakeups, WAKEUP_CONDITIONS_UPDATE,
+                     data->conditions_update->next);
 
     /* If astronomical data is unavailable, current conditions update
        will usually handle night/day. */
     if (data->current_astro) {
         if (data->night_time &&
             difftime(data->current_astro->sunrise, now_t) >= 0)
-            SCHEDULE_WAKEUP_COMPARE(data->current_astro->sunrise,
-                                    "sunrise icon change");
+            sunrise_t = data->current_astro->sunrise;
         if (!data->night_time &&
             difftime(data->current_astro->sunset, now_t) >= 0)
-            SCHEDULE_WAKEUP_COMPARE(data->current_astro->sunset,
-                                    "sunset icon change");
+            sunset_t = data->current_astro->sunset;
     }
-
-    if (diff > data->update_interval) {
-        /* next wakeup time is greater than the standard check
-           interval, so call the update handler earlier to deal with
-           cases like system resume events etc. */
-        diff = data->update_interval;
-        data->next_wakeup_reason = "regular check";
-    } else if (diff < 0) {
+    wakeup_queue_set(data->wakeups, WAKEUP_SUNRISE, sunrise_t);
+    wakeup_queue_set(data->wakeups, WAKEUP_SUNSET, sunset_t);
+
+    /* midnight is always queued, so there is a next wakeup */
+    wakeup_queue_peek(data->wakeups, &type, &data->next_wakeup);
+    data->next_wakeup_reason = wakeup_type_get_name(type);
+    diff = difftime(data->next_wakeup, now_t);
+    if (diff < 0) {
         /* last wakeup time expired, force update immediately */
         diff = 0;
         data->next_wakeup_reason = "forced";
     }
 
-    date = format_date(now_t, "%Y-%m-%d %H:%M:%S", TRUE);
+    date = format_date(now_t, "%Y-%m-%d %H:%M:%S", data->tz);
     data->update_timer =
         g_timeout_add_seconds((guint) diff,
                               (GSourceFunc) update_handler, data);
-    if (!strcmp(data->next_wakeup_reason, "regular check"))
-        weather_debug("[%s]: Running regular check for updates, "
-                      "interval %d secs.", date, data->update_interval);
-    else {
-        weather_dump(weather_dump_plugindata, data);
-        weather_debug("[%s]: Next wakeup in %.0f seconds, reason: %s",
-                      date, diff, data->next_wakeup_reason);
-    }
+    weather_dump(weather_dump_plugindata, data);
+    weather_debug("[%s]: Next wakeup in %.0f seconds, reason: %s",
+                  date, diff, data->next_wakeup_reason);
     g_free(date);
 }
 
@@ -765,6 +1336,17 @@ xfceweather_read_config(XfcePanelPlugin *plugin,
     data->cache_file_max_age =
         xfce_rc_read_int_entry(rc, "cache_file_max_age", CACHE_FILE_MAX_AGE);
 
+    data->download_interval_min =
+        xfce_rc_read_int_entry(rc, "download_interval_min",
+                               DOWNLOAD_INTERVAL_MIN);
+    constrain_to_limits(&data->download_interval_min,
+                        CONN_RETRY_INTERVAL_LARGE, 24 * 3600);
+    data->download_interval_max =
+        xfce_rc_read_int_entry(rc, "download_interval_max",
+                               DOWNLOAD_INTERVAL_MAX);
+    constrain_to_limits(&data->download_interval_max,
+                        data->download_interval_min, 24 * 3600);
+
     data->power_saving = xfce_rc_read_bool_entry(rc, "power_saving", TRUE);
 
     if (data->units)
@@ -816,9 +1398,6 @@ xfceweather_read_config(XfcePanelPlugin *plugin,
     if (value)
         gdk_color_parse(value, &(data->valuebox_color));
 
-    data->update_interval =
-        xfce_rc_read_int_entry(rc, "update_interval", DEFAULT_UPDATE_INTERVAL);
-
     xfce_rc_close(rc);
     weather_debug("Config file read.");
 }
@@ -864,6 +1443,12 @@ xfceweather_write_config(XfcePanelPlugin *plugin,
     xfce_rc_write_int_entry(rc, "cache_file_max_age",
                             data->cache_file_max_age);
 
+    xfce_rc_write_int_entry(rc, "download_interval_min",
+                            data->download_interval_min);
+
+    xfce_rc_write_int_entry(rc, "download_interval_max",
+                            data->download_interval_max);
+
     xfce_rc_write_bool_entry(rc, "power_saving", data->power_saving);
 
     xfce_rc_write_int_entry(rc, "units_temperature", data->units->temperature);
@@ -895,8 +1480,6 @@ xfceweather_write_config(XfcePanelPlugin *plugin,
     xfce_rc_write_entry(rc, "valuebox_color", value);
     g_free(value);
 
-    xfce_rc_write_int_entry(rc, "update_interval", data->update_interval);
-    
     xfce_rc_close(rc);
     weather_debug("Config file written.");
 }
@@ -922,23 +1505,24 @@ make_cache_filename(plugin_data *data)
 }
 
 
-static void
-write_cache_file(plugin_data *data)
+/*
+ * Serialize the weather data in the old text format, which is easy to
+ * inspect but slow to read. It is only written in debug mode.
+ */
+static GString *
+make_text_cache(plugin_data *data)
 {
     GString *out;
     xml_weather *wd = data->weatherdata;
     xml_time *timeslice;
     xml_location *loc;
     xml_astro *astro;
-    gchar *file, *start, *end, *point, *now, *value;
+    gchar *start, *end, *point, *now, *value;
     gchar *date_format = "%Y-%m-%dT%H:%M:%SZ";
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
     time_t now_t = time(NULL);
     gint i, j;
 
-    file = make_cache_filename(data);
-    if (G_UNLIKELY(file == NULL))
-        return;
-
     out = g_string_sized_new(20480);
     g_string_assign(out, "# xfce4-weather-plugin cache file\n\n[info]\n");
     CACHE_APPEND("location_name=%s\n", data->location_name);
@@ -947,16 +1531,16 @@ write_cache_file(plugin_data *data)
     g_string_append_printf(out, "msl=%d\n", data->msl);
     g_string_append_printf(out, "timeslices=%d\n", wd->timeslices->len);
     if (G_LIKELY(data->weather_update)) {
-        value = format_date(data->weather_update->last, date_format, FALSE);
+        value = format_date(data->weather_update->last, date_format, NULL);
         CACHE_APPEND("last_weather_download=%s\n", value);
         g_free(value);
     }
     if (G_LIKELY(data->astro_update)) {
-        value = format_date(data->astro_update->last, date_format, FALSE);
+        value = format_date(data->astro_update->last, date_format, NULL);
         CACHE_APPEND("last_astro_download=%s\n", value);
         g_free(value);
     }
-    now = format_date(now_t, date_format, FALSE);
+    now = format_date(now_t, date_format, NULL);
     CACHE_APPEND("cache_date=%s\n\n", now);
     g_free(now);
 
@@ -965,9 +1549,9 @@ write_cache_file(plugin_data *data)
             astro = g_array_index(data->astrodata, xml_astro *, i);
             if (G_UNLIKELY(astro == NULL))
                 continue;
-            value = format_date(astro->day, "%Y-%m-%d", TRUE);
-            start = format_date(astro->sunrise, date_format, FALSE);
-            end = format_date(astro->sunset, date_format, FALSE);
+            value = format_date(astro->day, "%Y-%m-%d", data->tz);
+            start = format_date(astro->sunrise, date_format, NULL);
+            end = format_date(astro->sunset, date_format, NULL);
             g_string_append_printf(out, "[astrodata%d]\n", i);
             CACHE_APPEND("day=%s\n", value);
             CACHE_APPEND("sunrise=%s\n", start);
@@ -980,8 +1564,8 @@ write_cache_file(plugin_data *data)
             g_free(start);
             g_free(end);
 
-            start = format_date(astro->moonrise, date_format, FALSE);
-            end = format_date(astro->moonset, date_format, FALSE);
+            start = format_date(astro->moonrise, date_format, NULL);
+            end = format_date(astro->moonset, date_format, NULL);
             CACHE_APPEND("moonrise=%s\n", start);
             CACHE_APPEND("moonset=%s\n", end);
             CACHE_APPEND("moon_never_rises=%s\n",
@@ -1002,52 +1586,120 @@ write_cache_file(plugin_data *data)
         if (G_UNLIKELY(timeslice == NULL || timeslice->location == NULL))
             continue;
         loc = timeslice->location;
-        start = format_date(timeslice->start, date_format, FALSE);
-        end = format_date(timeslice->end, date_format, FALSE);
-        point = format_date(timeslice->point, date_format, FALSE);
+        start = format_date(timeslice->start, date_format, NULL);
+        end = format_date(timeslice->end, date_format, NULL);
+        point = format_date(timeslice->point, date_format, NULL);
         g_string_append_printf(out, "[timeslice%d]\n", i);
         CACHE_APPEND("start=%s\n", start);
         CACHE_APPEND("end=%s\n", end);
         CACHE_APPEND("point=%s\n", point);
-        CACHE_APPEND("altitude=%s\n", loc->altitude);
-        CACHE_APPEND("latitude=%s\n", loc->latitude);
-        CACHE_APPEND("longitude=%s\n", loc->longitude);
-        CACHE_APPEND("temperature_value=%s\n", loc->temperature_value);
-        CACHE_APPEND("temperature_unit=%s\n", loc->temperature_unit);
-        CACHE_APPEND("wind_dir_deg=%s\n", loc->wind_dir_deg);
-        CACHE_APPEND("wind_dir_name=%s\n", loc->wind_dir_name);
-        CACHE_APPEND("wind_speed_mps=%s\n", loc->wind_speed_mps);
-        CACHE_APPEND("wind_speed_beaufort=%s\n", loc->wind_speed_beaufort);
-        CACHE_APPEND("humidity_value=%s\n", loc->humidity_value);
-        CACHE_APPEND("humidity_unit=%s\n", loc->humidity_unit);
-        CACHE_APPEND("pressure_value=%s\n", loc->pressure_value);
-        CACHE_APPEND("pressure_unit=%s\n", loc->pressure_unit);
         g_free(start);
         g_free(end);
         g_free(point);
-        for (j = 0; j < CLOUDS_PERC_NUM; j++)
-            if (loc->clouds_percent[j])
-                g_string_append_printf(out, "clouds_percent_%d=%s\n", j,
-                                       loc->clouds_percent[j]);
-        CACHE_APPEND("fog_percent=%s\n", loc->fog_percent);
-        CACHE_APPEND("precipitation_value=%s\n", loc->precipitation_value);
-        CACHE_APPEND("precipitation_unit=%s\n", loc->precipitation_unit);
-        if (loc->symbol)
+        for (j = 0; j < LOC_VALUES_NUM; j++)
+            if (LOC_HAS(loc, j))
+                g_string_append_printf(out, "%s=%s\n", cache_location_keys[j],
+                                       g_ascii_formatd(buf, sizeof(buf),
+                                                       "%.10g",
+                                                       loc->values[j]));
+        if (LOC_HAS(loc, LOC_SYMBOL))
             g_string_append_printf(out, "symbol_id=%d\nsymbol=%s\n",
-                                   loc->symbol_id, loc->symbol);
+                                   loc->symbol_id,
+                                   symbol_names[loc->symbol_id]);
         g_string_append(out, "\n");
     }
 
-    if (!g_file_set_contents(file, out->str, -1, NULL))
-        g_warning(_("Error writing cache file %s!"), file);
-    else
-        weather_debug("Cache file %s has been written.", file);
+    return out;
+}
+
+
+/*
+ * Queue a write of the given contents, which the worker thread
+ * takes ownership of.
+ */
+static void
+queue_cache_write(plugin_data *data,
+                  gchar *file,
+                  gchar *contents,
+                  gsize len)
+{
+    weather_job *job;
+
+    job = g_slice_new0(weather_job);
+    job->data = data;
+    job->cache_file = file;
+    job->cache_contents = contents;
+    job->cache_len = len;
+    weather_worker_push(data, job);
+}
+
 
-    g_string_free(out, TRUE);
+/*
+ * Take a snapshot of the current data and let the worker thread
+ * write it, so that disk I/O does not block the main loop.
+ */
+static void
+write_cache_file(plugin_data *data)
+{
+    GByteArray *out;
+    GString *text;
+    gchar *file;
+    guint len;
+
+    /* never replace a cache file with one holding no weather data */
+    if (G_UNLIKELY(data->weatherdata == NULL ||
+                   data->weatherdata->timeslices->len == 0))
+        return;
+
+    file = make_cache_filename(data);
+    if (G_UNLIKELY(file == NULL))
+        return;
+
+    out = cache_file_serialize(data);
+    if (G_LIKELY(out)) {
+        len = out->len;
+        queue_cache_write(data,
+                          g_strconcat(file, CACHE_FILE_BINARY_SUFFIX, NULL),
+                          (gchar *) g_byte_array_free(out, FALSE), len);
+    }
+
+    if (debug_mode) {
+        text = make_text_cache(data);
+        len = text->len;
+        queue_cache_write(data, g_strdup(file),
+                          g_string_free(text, FALSE), len);
+    }
     g_free(file);
 }
 
 
+static gboolean
+cb_write_cache_file(gpointer user_data)
+{
+    plugin_data *data = user_data;
+
+    data->cache_write_timer = 0;
+    write_cache_file(data);
+    return FALSE;
+}
+
+
+/*
+ * Write the cache file after a short delay, so that updates finishing
+ * in quick succession only cause a single write.
+ */
+static void
+schedule_cache_write(plugin_data *data)
+{
+    if (data->cache_write_timer) {
+        weather_debug("Cache file write already scheduled.");
+        return;
+    }
+    data->cache_write_timer =
+        g_timeout_add_seconds(CACHE_WRITE_DELAY, cb_write_cache_file, data);
+}
+
+
 static void
 read_cache_file(plugin_data *data)
 {
@@ -1058,14 +1710,14 @@ read_cache_file(plugin_data *data)
     xml_location *loc = NULL;
     xml_astro *astro = NULL;
     time_t now_t = time(NULL), cache_date_t;
-    gchar *file, *locname = NULL, *lat = NULL, *lon = NULL, *group = NULL;
+    gchar *file, *binfile, *locname = NULL, *lat = NULL, *lon = NULL;
+    gchar *group = NULL;
     gchar *timestring;
     gint msl, num_timeslices = 0, i, j;
 
     g_assert(data != NULL);
     if (G_UNLIKELY(data == NULL))
         return;
-    wd = data->weatherdata;
 
     if (G_UNLIKELY(data->lat == NULL || data->lon == NULL))
         return;
@@ -1074,6 +1726,23 @@ read_cache_file(plugin_data *data)
     if (G_UNLIKELY(file == NULL))
         return;
 
+    /* prefer the binary cache, the text format is read for migration */
+    binfile = g_strconcat(file, CACHE_FILE_BINARY_SUFFIX, NULL);
+    if (cache_file_load(data, binfile)) {
+        g_free(binfile);
+        g_free(file);
+        if (G_LIKELY(data->weather_update))
+            data->weather_update->next =
+                calc_next_weather_download_time(data,
+                                                data->weather_update->last);
+        if (G_LIKELY(data->astro_update))
+            data->astro_update->next =
+                calc_next_download_time(data->astro_update,
+                                        data->astro_update->last);
+        return;
+    }
+    g_free(binfile);
+
     keyfile = g_key_file_new();
     if (!g_key_file_load_from_file(keyfile, file, G_KEY_FILE_NONE, NULL)) {
         weather_debug("Could not read cache file %s.", file);
@@ -1113,7 +1782,7 @@ read_cache_file(plugin_data *data)
     }
     /* read cache creation date and check if cache file is not too old */
     CACHE_READ_STRING(timestring, "cache_date");
-    cache_date_t = parse_timestring(timestring, NULL, FALSE);
+    cache_date_t = parse_timestring(timestring, NULL, NULL);
     g_free(timestring);
     if (difftime(now_t, cache_date_t) > data->cache_file_max_age) {
         weather_debug("Cache file is too old and will not be used.");
@@ -1122,15 +1791,15 @@ read_cache_file(plugin_data *data)
     }
     if (G_LIKELY(data->weather_update)) {
         CACHE_READ_STRING(timestring, "last_weather_download");
-        data->weather_update->last = parse_timestring(timestring, NULL, FALSE);
+        data->weather_update->last = parse_timestring(timestring, NULL, NULL);
         data->weather_update->next =
-            calc_next_download_time(data->weather_update,
-                                    data->weather_update->last);
+            calc_next_weather_download_time(data,
+                                            data->weather_update->last);
         g_free(timestring);
     }
     if (G_LIKELY(data->astro_update)) {
         CACHE_READ_STRING(timestring, "last_astro_download");
-        data->astro_update->last = parse_timestring(timestring, NULL, FALSE);
+        data->astro_update->last = parse_timestring(timestring, NULL, NULL);
         data->astro_update->next =
             calc_next_download_time(data->astro_update,
                                     data->astro_update->last);
@@ -1144,18 +1813,18 @@ read_cache_file(plugin_data *data)
         if (i == 0)
             weather_debug("Reusing cached astrodata instead of downloading it.");
 
-        astro = g_slice_new0(xml_astro);
+        astro = make_astro();
         if (G_UNLIKELY(astro == NULL))
             break;
 
         CACHE_READ_STRING(timestring, "day");
-        astro->day = parse_timestring(timestring, "%Y-%m-%d", TRUE);
+        astro->day = parse_timestring(timestring, "%Y-%m-%d", data->tz);
         g_free(timestring);
         CACHE_READ_STRING(timestring, "sunrise");
-        astro->sunrise = parse_timestring(timestring, NULL, FALSE);
+        astro->sunrise = parse_timestring(timestring, NULL, NULL);
         g_free(timestring);
         CACHE_READ_STRING(timestring, "sunset");
-        astro->sunset = parse_timestring(timestring, NULL, FALSE);
+        astro->sunset = parse_timestring(timestring, NULL, NULL);
         g_free(timestring);
         astro->sun_never_rises =
             g_key_file_get_boolean(keyfile, group, "sun_never_rises", NULL);
@@ -1163,10 +1832,10 @@ read_cache_file(plugin_data *data)
             g_key_file_get_boolean(keyfile, group, "sun_never_sets", NULL);
 
         CACHE_READ_STRING(timestring, "moonrise");
-        astro->moonrise = parse_timestring(timestring, NULL, FALSE);
+        astro->moonrise = parse_timestring(timestring, NULL, NULL);
         g_free(timestring);
         CACHE_READ_STRING(timestring, "moonset");
-        astro->moonset = parse_timestring(timestring, NULL, FALSE);
+        astro->moonset = parse_timestring(timestring, NULL, NULL);
         g_free(timestring);
         CACHE_READ_STRING(astro->moon_phase, "moon_phase");
         astro->moon_never_rises =
@@ -1175,7 +1844,6 @@ read_cache_file(plugin_data *data)
             g_key_file_get_boolean(keyfile, group, "moon_never_sets", NULL);
 
         merge_astro(data->astrodata, astro);
-        xml_astro_free(astro);
 
         g_free(group);
         group = g_strdup_printf("astrodata%d", ++i);
@@ -1183,8 +1851,9 @@ read_cache_file(plugin_data *data)
     g_free(group);
     group = NULL;
 
-    /* parse available timeslices */
-    for (i = 0; i < num_timeslices; i++) {
+    /* parse available timeslices, they are merged all at once */
+    wd = make_weather_data();
+    for (i = 0; wd && i < num_timeslices; i++) {
         group = g_strdup_printf("timeslice%d", i);
         if (!g_key_file_has_group(keyfile, group)) {
             weather_debug("Group %s not found, continuing with next.", group);
@@ -1200,50 +1869,35 @@ read_cache_file(plugin_data *data)
 
         /* parse time strings (start, end, point) */
         CACHE_READ_STRING(timestring, "start");
-        timeslice->start = parse_timestring(timestring, NULL, FALSE);
+        timeslice->start = parse_timestring(timestring, NULL, NULL);
         g_free(timestring);
         CACHE_READ_STRING(timestring, "end");
-        timeslice->end = parse_timestring(timestring, NULL, FALSE);
+        timeslice->end = parse_timestring(timestring, NULL, NULL);
         g_free(timestring);
         CACHE_READ_STRING(timestring, "point");
-        timeslice->point = parse_timestring(timestring, NULL, FALSE);
+        timeslice->point = parse_timestring(timestring, NULL, NULL);
         g_free(timestring);
 
         /* parse location data */
         loc = timeslice->location;
-        CACHE_READ_STRING(loc->altitude, "altitude");
-        CACHE_READ_STRING(loc->latitude, "latitude");
-        CACHE_READ_STRING(loc->longitude, "longitude");
-        CACHE_READ_STRING(loc->temperature_value, "temperature_value");
-        CACHE_READ_STRING(loc->temperature_unit, "temperature_unit");
-        CACHE_READ_STRING(loc->wind_dir_name, "wind_dir_name");
-        CACHE_READ_STRING(loc->wind_dir_deg, "wind_dir_deg");
-        CACHE_READ_STRING(loc->wind_speed_mps, "wind_speed_mps");
-        CACHE_READ_STRING(loc->wind_speed_beaufort, "wind_speed_beaufort");
-        CACHE_READ_STRING(loc->humidity_value, "humidity_value");
-        CACHE_READ_STRING(loc->humidity_unit, "humidity_unit");
-        CACHE_READ_STRING(loc->pressure_value, "pressure_value");
-        CACHE_READ_STRING(loc->pressure_unit, "pressure_unit");
-
-        for (j = 0; j < CLOUDS_PERC_NUM; j++) {
-            gchar *key = g_strdup_printf("clouds_percent_%d", j);
-            if (g_key_file_has_key(keyfile, group, key, NULL))
-                loc->clouds_percent[j] =
-                    g_key_file_get_string(keyfile, group, key, NULL);
-            g_free(key);
+        for (j = 0; j < LOC_VALUES_NUM; j++) {
+            CACHE_READ_STRING(timestring, cache_location_keys[j]);
+            if (timestring && *timestring)
+                LOC_SET(loc, j, g_ascii_strtod(timestring, NULL));
+            g_free(timestring);
         }
-
-        CACHE_READ_STRING(loc->fog_percent, "fog_percent");
-        CACHE_READ_STRING(loc->precipitation_value, "precipitation_value");
-        CACHE_READ_STRING(loc->precipitation_unit, "precipitation_unit");
-        CACHE_READ_STRING(loc->symbol, "symbol");
-        if (loc->symbol &&
-            g_key_file_has_key(keyfile, group, "symbol_id", NULL))
-            loc->symbol_id =
-                g_key_file_get_integer(keyfile, group, "symbol_id", NULL);
-
-        merge_timeslice(wd, timeslice);
-        xml_time_free(timeslice);
+        /* older cache files store the unmapped met.no symbol number */
+        if (g_key_file_has_key(keyfile, group, "symbol_id", NULL))
+            LOC_SET_SYMBOL(loc, normalize_symbol_id
+                           (g_key_file_get_integer(keyfile, group,
+                                                   "symbol_id", NULL)));
+
+        g_array_append_val(wd->timeslices, timeslice);
+        xml_weather_index_add(wd, timeslice);
+    }
+    if (G_LIKELY(wd)) {
+        merge_weather(data->weatherdata, wd);
+        xml_weather_free(wd);
     }
     CACHE_FREE_VARS();
     weather_debug("Reading cache file complete.");
@@ -1253,6 +1907,7 @@ read_cache_file(plugin_data *data)
 void
 update_weatherdata_with_reset(plugin_data *data)
 {
+    SoupMessage *msg;
     time_t now_t;
     GSource *source;
 
@@ -1275,24 +1930,46 @@ update_weatherdata_with_reset(plugin_data *data)
     /* clear update times */
     init_update_infos(data);
 
-    /* clear existing weather data */
+    /* the pending cache write belongs to the previous location */
+    if (data->cache_write_timer) {
+        g_source_remove(data->cache_write_timer);
+        data->cache_write_timer = 0;
+    }
+
+    /* responses of running downloads belong to the old settings */
+    if ((msg = data->weather_msg)) {
+        data->weather_msg = NULL;
+        soup_session_cancel_message(data->session, msg,
+                                    SOUP_STATUS_CANCELLED);
+    }
+    if ((msg = data->astro_msg)) {
+        data->astro_msg = NULL;
+        soup_session_cancel_message(data->session, msg,
+                                    SOUP_STATUS_CANCELLED);
+    }
+
+    /* clear existing weather data, discarding data being processed */
+    data->weather_generation++;
     if (data->weatherdata) {
         xml_weather_free(data->weatherdata);
         data->weatherdata = make_weather_data();
     }
 
     /* clear existing astronomical data */
+    data->current_astro = NULL;
     if (data->astrodata) {
         astrodata_free(data->astrodata);
         data->astrodata = g_array_sized_new(FALSE, TRUE, sizeof(xml_astro *), 30);
     }
 
     /* update GUI to display NODATA */
+    invalidate_tooltip(data);
     update_icon(data);
     update_valuebox(data, TRUE);
 
     /* make use of previously saved data */
     read_cache_file(data);
+    invalidate_forecast_grid(data);
 
     /* schedule downloads immediately */
     time(&now_t);
@@ -1457,6 +2134,22 @@ upower_changed_cb(UpClient *client,
 #endif /* HAVE_UPOWER_GLIB */
 
 
+/*
+ * The timer does not run while the system is suspended and does not
+ * follow changes of the wall clock, so deadlines that passed in the
+ * meantime need to be taken care of right away.
+ */
+static void
+cb_system_wakeup(gpointer user_data)
+{
+    plugin_data *data = user_data;
+
+    weather_debug("System resumed or clock changed, "
+                  "checking for expired deadlines.");
+    update_handler(data);
+}
+
+
 static void
 xfceweather_dialog_response(GtkWidget *dlg,
                             gint response,
@@ -1546,9 +2239,9 @@ weather_get_tooltip_text(const plugin_data *data)
     }
 
     /* times for forecast and point data */
-    point = format_date(conditions->point, "%H:%M", TRUE);
-    interval_start = format_date(conditions->start, "%H:%M", TRUE);
-    interval_end = format_date(conditions->end, "%H:%M", TRUE);
+    point = format_date(conditions->point, "%H:%M", data->tz);
+    interval_start = format_date(conditions->start, "%H:%M", data->tz);
+    interval_end = format_date(conditions->end, "%H:%M", data->tz);
 
     /* use sunrise and sunset times if available */
     if (data->current_astro)
@@ -1560,9 +2253,9 @@ weather_get_tooltip_text(const plugin_data *data)
             sunset = g_strdup(_("The sun never sets today."));
         } else {
             sunrise = format_date(data->current_astro->sunrise,
-                                  "%H:%M", TRUE);
+                                  "%H:%M", data->tz);
             sunset = format_date(data->current_astro->sunset,
-                                 "%H:%M", TRUE);
+                                 "%H:%M", data->tz);
         }
 
     sym = get_data(conditions, data->units, SYMBOL, FALSE, data->night_time);
@@ -1669,14 +2362,18 @@ weather_get_tooltip_cb(GtkWidget *widget,
                        GtkTooltip *tooltip,
                        plugin_data *data)
 {
-    gchar *markup_text;
-
     if (data->weatherdata == NULL)
         gtk_tooltip_set_text(tooltip, _("Cannot update weather data"));
     else {
-        markup_text = weather_get_tooltip_text(data);
-        gtk_tooltip_set_markup(tooltip, markup_text);
-        g_free(markup_text);
+        /* the tooltip is queried repeatedly while hovering, so only
+           render it again when something has changed */
+        if (data->tooltip_markup == NULL ||
+            data->tooltip_markup_generation != data->tooltip_generation) {
+            g_free(data->tooltip_markup);
+            data->tooltip_markup = weather_get_tooltip_text(data);
+            data->tooltip_markup_generation = data->tooltip_generation;
+        }
+        gtk_tooltip_set_markup(tooltip, data->tooltip_markup);
     }
 
     gtk_tooltip_set_icon(tooltip, data->tooltip_icon);
@@ -1704,8 +2401,13 @@ xfceweather_create_control(XfcePanelPlugin *plugin)
 #endif
     data->units = g_slice_new0(units_config);
     data->weatherdata = make_weather_data();
+    data->weather_results = g_async_queue_new();
+    data->weather_pool = g_thread_pool_new(weather_worker, NULL,
+                                           1, FALSE, NULL);
     data->astrodata = g_array_sized_new(FALSE, TRUE, sizeof(xml_astro *), 30);
     data->cache_file_max_age = CACHE_FILE_MAX_AGE;
+    data->download_interval_min = DOWNLOAD_INTERVAL_MIN;
+    data->download_interval_max = DOWNLOAD_INTERVAL_MAX;
     data->tooltip_style = TOOLTIP_VERBOSE;
     data->forecast_layout = FC_LAYOUT_LIST;
     data->forecast_days = DEFAULT_FORECAST_DAYS;
@@ -1715,6 +2417,7 @@ xfceweather_create_control(XfcePanelPlugin *plugin)
 
     /* Setup update infos */
     init_update_infos(data);
+    data->wakeups = make_wakeup_queue();
     data->next_wakeup = time(NULL);
 
     /* Setup session for HTTP connections */
@@ -1809,6 +2512,7 @@ xfceweather_free(XfcePanelPlugin *plugin,
                  plugin_data *data)
 {
     GSource *source;
+    weather_job *job;
 
     weather_debug("Freeing plugin data.");
     g_assert(data != NULL);
@@ -1826,6 +2530,29 @@ xfceweather_free(XfcePanelPlugin *plugin,
         g_object_unref(data->upower);
 #endif
 
+    /* cancel running downloads while the worker can still finish
+       them, their callbacks must not run after data has been freed */
+    soup_session_abort(data->session);
+
+    /* write pending cache data before the worker is shut down */
+    if (data->cache_write_timer) {
+        g_source_remove(data->cache_write_timer);
+        data->cache_write_timer = 0;
+        write_cache_file(data);
+    }
+
+    /* let the worker finish queued jobs and drop their results */
+    if (data->weather_pool)
+        g_thread_pool_free(data->weather_pool, FALSE, TRUE);
+    data->weather_pool = NULL;
+    while (g_idle_remove_by_data(data));
+    while ((job = g_async_queue_try_pop(data->weather_results))) {
+        xml_weather_free(job->wd);
+        weather_job_free(job);
+    }
+    g_async_queue_unref(data->weather_results);
+    data->weather_results = NULL;
+
     if (data->weatherdata)
         xml_weather_free(data->weatherdata);
 
@@ -1842,14 +2569,20 @@ xfceweather_free(XfcePanelPlugin *plugin,
     g_free(data->timezone);
     g_free(data->timezone_initial);
     g_free(data->geonames_username);
+    g_free(data->tooltip_markup);
+    if (data->tz)
+        g_time_zone_unref(data->tz);
 
     /* free update infos */
-    g_slice_free(update_info, data->weather_update);
-    g_slice_free(update_info, data->astro_update);
-    g_slice_free(update_info, data->conditions_update);
+    update_info_free(data->weather_update);
+    update_info_free(data->astro_update);
+    update_info_free(data->conditions_update);
+    wakeup_monitor_free(data->wakeup_events);
+    wakeup_queue_free(data->wakeups);
 
     /* free current data */
     data->current_astro = NULL;
+    invalidate_forecast_grid(data);
 
     /* free arrays */
     astrodata_free(data->astrodata);
@@ -1871,6 +2604,9 @@ xfceweather_set_size(XfcePanelPlugin *panel,
     if (data->single_row)
         size /= data->panel_rows;
 #endif
+    /* icons of the old size will not be needed anymore */
+    if (size != data->panel_size)
+        icon_theme_clear_cache(data->icon_theme);
     data->panel_size = size;
 
     update_icon(data);
@@ -1996,14 +2732,23 @@ weather_construct(XfcePanelPlugin *plugin)
     weather_debug_init(G_LOG_DOMAIN, debug_mode);
     weather_debug("weather plugin version " VERSION " starting up");
 
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+    /* weather data is processed in a worker thread */
+    if (!g_thread_supported())
+        g_thread_init(NULL);
+#endif
+    xmlInitParser();
+
     data = xfceweather_create_control(plugin);
 
-    /* save initial timezone so we can reset it later */
+    /* remember the timezone of the environment, used when the
+       location has none configured */
     data->timezone_initial = g_strdup(g_getenv("TZ"));
 
     xfceweather_read_config(plugin, data);
     update_timezone(data);
     read_cache_file(data);
+    invalidate_forecast_grid(data);
     update_current_conditions(data, TRUE);
 
     gtk_widget_modify_font(
@@ -2053,6 +2798,8 @@ weather_construct(XfcePanelPlugin *plugin)
     }
 #endif /* HAVE_UPOWER_GLIB */
 
+    data->wakeup_events = make_wakeup_monitor(cb_system_wakeup, data);
+
     weather_dump(weather_dump_plugindata, data);
 }
 
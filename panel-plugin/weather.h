@@ -26,6 +26,7 @@
 #include <upower.h>
 #endif
 #include "weather-icon.h"
+#include "weather-scheduler.h"
 
 #define PLUGIN_WEBSITE "http://goodies.xfce.org/projects/panel-plugins/xfce4-weather-plugin"
 #define MAX_FORECAST_DAYS 10
@@ -60,6 +61,10 @@ typedef struct {
     gboolean started;
     gboolean finished;
     guint http_status_code;
+    gchar *etag;                /* validators of the last response, */
+    gchar *last_modified;       /* used for conditional requests */
+    time_t expires;
+    time_t next_run;            /* next model run of the data */
 } update_info;
 
 typedef struct {
@@ -89,17 +94,28 @@ typedef struct {
     GtkOrientation panel_orientation;
     gboolean single_row;
     xml_weather *weatherdata;
+    GThreadPool *weather_pool;      /* parses and merges weather data */
+    GAsyncQueue *weather_results;   /* processed data for the main loop */
+    guint weather_generation;       /* increased when data gets reset */
+    guint cache_write_timer;        /* pending cache file write */
+    SoupMessage *weather_msg;       /* running weather download */
+    SoupMessage *astro_msg;         /* running astrodata download */
     GArray *astrodata;
     xml_astro *current_astro;
+    forecast_grid *forecast;        /* calculated when first needed */
+    gchar *tooltip_markup;          /* rendered for tooltip_generation */
+    guint tooltip_generation;       /* increased when the tooltip changes */
+    guint tooltip_markup_generation;
 
     update_info *astro_update;
     update_info *weather_update;
     update_info *conditions_update;
+    wakeup_queue *wakeups;          /* deadlines of pending updates */
+    wakeup_monitor *wakeup_events;  /* resume and clock change events */
     time_t next_wakeup;
-    gchar *next_wakeup_reason;
+    const gchar *next_wakeup_reason;
     guint update_timer;
     guint summary_update_timer;
-    guint update_interval;
 
     GtkWidget *valuebox;
     gchar *valuebox_font;
@@ -111,7 +127,10 @@ typedef struct {
     gint msl;
     gchar *timezone;
     gchar *timezone_initial;
+    GTimeZone *tz;              /* used for all local time calculations */
     gint cache_file_max_age;
+    gint download_interval_min; /* limits for scheduling downloads */
+    gint download_interval_max; /* from the data's expiry, in seconds */
     gboolean night_time;
 
     units_config *units;
@@ -140,6 +159,12 @@ gchar *get_cache_directory(void);
 
 void update_timezone(plugin_data *data);
 
+void invalidate_forecast_grid(plugin_data *data);
+
+forecast_grid *get_forecast_grid(plugin_data *data);
+
+void invalidate_tooltip(plugin_data *data);
+
 void update_icon(plugin_data *data);
 
 void update_valuebox(plugin_data *data,